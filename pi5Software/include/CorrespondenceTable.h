@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "Vec2f.h"
+#include "Line.h"
+#include "Environment.h"
+#include "Run_Type.h"
+#include "FastMath.h"
+#include "MappedGrid.h"
+
+// The landmark a lidar ray hits, precomputed per position cell and world angle bin for one Environment
+// Replaces the five ray casts of Slam::isPointUseable with a lookup; The cell, the angle bin and the maxDeltaPosition box
+// around the position are all covered, so an entry is only unambiguous if every position and angle it stands for hits the same landmark
+// Saved to a file per arena variant and memory mapped on the next start; A file of another arena or other parameters is rebuilt
+
+#define CORRESPONDENCE_TABLE_MAGIC 0x4C4252544F525257ULL // "WRROTRBL"
+#define CORRESPONDENCE_TABLE_VERSION 1
+#define CORRESPONDENCE_CELL_SIZE 0.025f  // 120 x 120 cells in the 3 m arena, 20 MB with the angle bins
+#define CORRESPONDENCE_ANGLE_BINS 360    // 1 degree
+#define CORRESPONDENCE_RAY_LENGTH 1000.0f // Same as the rays of Slam::isPointUseable
+
+enum CORRESPONDENCE_FLAG : uint8_t {
+    CORRESPONDENCE_AMBIGUOUS = 1, // The rays of the cell and the maxDeltaPosition box hit different landmarks or none
+    CORRESPONDENCE_NO_HIT = 2,    // The ray from the cell centre hits nothing, there is no expected range
+};
+
+struct CorrespondenceEntry {
+    int8_t landmark;          // Landmark index, -1 if ambiguous
+    uint8_t flags;            // CORRESPONDENCE_FLAG
+    uint16_t expectedRangeMm; // Range of the wall from the cell centre along the bin centre angle
+};
+
+struct CorrespondenceTableHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t cellsPerSide;
+    uint32_t angleBins;
+    uint32_t landmarkHash; // Of the landmark lines and flags, a changed arena invalidates the file
+    float cellSize;
+    float maxDeltaPosition;
+    float originX;
+    float originY;
+};
+
+class CorrespondenceTable
+{
+public:
+    static std::string defaultPath(enum RUN_TYPE runType, bool parkingObstacle)
+    {
+        return MappedGrid<CorrespondenceTableHeader, CorrespondenceEntry>::defaultPath("correspondenceTable", runType, parkingObstacle);
+    }
+
+    // Maps the file if it was built for this environment and maxDeltaPosition, otherwise builds the table and saves it to the file
+    // An empty path only builds; Always ends with a usable table
+    bool loadOrBuild(const std::string& path, const Environment& environment, float maxDeltaPosition)
+    {
+        if (!path.empty() && load(path, environment, maxDeltaPosition)) {
+            printf("[CORRESPONDENCE TABLE] Mapped %s\n", path.c_str());
+            return true;
+        }
+        build(environment, maxDeltaPosition);
+        printf("[CORRESPONDENCE TABLE] Built %zu entries\n", grid.size());
+        if (!path.empty() && !save(path)) printf("[CORRESPONDENCE TABLE] Could not save %s, it is built again on the next start\n", path.c_str());
+        return true;
+    }
+
+    [[nodiscard]] bool isReady() const {return grid.isReady();}
+    [[nodiscard]] float maxDeltaPosition() const {return grid.header().maxDeltaPosition;}
+
+    const CorrespondenceEntry& lookup(const Vec2f& position, float worldAngle) const
+    {
+        const CorrespondenceTableHeader& header = grid.header();
+        int cx = std::clamp(int((position.x - header.originX) * inverseCellSize), 0, int(header.cellsPerSide) - 1);
+        int cy = std::clamp(int((position.y - header.originY) * inverseCellSize), 0, int(header.cellsPerSide) - 1);
+        int bin = int(FastMath::wrapAngle(worldAngle) * angleBinsPerRadian);
+        if (bin >= int(header.angleBins)) bin = header.angleBins - 1;
+        return grid.data()[(size_t(cy) * header.cellsPerSide + cx) * header.angleBins + bin];
+    }
+
+    void build(const Environment& environment, float pMaxDeltaPosition)
+    {
+        CorrespondenceTableHeader header = makeHeader(environment, pMaxDeltaPosition);
+        setScale(header);
+        CorrespondenceEntry* built = grid.allocate(header, entryCount(header));
+
+        const float binWidth = float(2.0 * M_PI) / header.angleBins;
+        const float halfBox = pMaxDeltaPosition + header.cellSize * 0.5f; // Every position of the cell plus the box around it
+        for (uint32_t cy = 0; cy < header.cellsPerSide; cy++) {
+            for (uint32_t cx = 0; cx < header.cellsPerSide; cx++) {
+                Vec2f centre(header.originX + (cx + 0.5f) * header.cellSize, header.originY + (cy + 0.5f) * header.cellSize);
+                Vec2f corners[4] = {
+                    centre + Vec2f(-halfBox, -halfBox), centre + Vec2f(-halfBox, halfBox),
+                    centre + Vec2f(halfBox, halfBox), centre + Vec2f(halfBox, -halfBox)
+                };
+                for (Vec2f& corner : corners) corner = clampCorner(corner, centre, environment);
+
+                for (uint32_t bin = 0; bin < header.angleBins; bin++) {
+                    CorrespondenceEntry& entry = built[(size_t(cy) * header.cellsPerSide + cx) * header.angleBins + bin];
+                    entry = buildEntry(environment, centre, corners, bin * binWidth, (bin + 1) * binWidth);
+                }
+            }
+        }
+    }
+
+    bool save(const std::string& path) const {return grid.save(path, "[CORRESPONDENCE TABLE]");}
+
+    bool load(const std::string& path, const Environment& environment, float pMaxDeltaPosition)
+    {
+        CorrespondenceTableHeader expected = makeHeader(environment, pMaxDeltaPosition);
+        if (!grid.load(path, expected, entryCount(expected), "[CORRESPONDENCE TABLE]")) return false;
+        setScale(expected);
+        return true;
+    }
+
+private:
+    static CorrespondenceTableHeader makeHeader(const Environment& environment, float pMaxDeltaPosition)
+    {
+        CorrespondenceTableHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = CORRESPONDENCE_TABLE_MAGIC;
+        h.version = CORRESPONDENCE_TABLE_VERSION;
+        h.cellSize = CORRESPONDENCE_CELL_SIZE;
+        Vec2f extent = environment.outerTopRight - environment.outerBottomLeft;
+        h.cellsPerSide = uint32_t(ceilf(std::max(extent.x, extent.y) / h.cellSize));
+        h.angleBins = CORRESPONDENCE_ANGLE_BINS;
+        h.landmarkHash = environment.landmarkHash();
+        h.maxDeltaPosition = pMaxDeltaPosition;
+        h.originX = environment.outerBottomLeft.x;
+        h.originY = environment.outerBottomLeft.y;
+        return h;
+    }
+
+    // The same treatment the corners get in Slam::isPointUseable
+    static Vec2f clampCorner(Vec2f p, const Vec2f& centre, const Environment& environment)
+    {
+        p.x = std::clamp(p.x, environment.outerBottomLeft.x + 0.001f, environment.outerTopRight.x - 0.001f);
+        p.y = std::clamp(p.y, environment.outerBottomLeft.y + 0.001f, environment.outerTopRight.y - 0.001f);
+        if (p.x > environment.innerBottomLeft.x && p.x < environment.innerTopRight.x && p.y > environment.innerBottomLeft.y && p.y < environment.innerTopRight.y) {
+            p = centre;
+        }
+        return p;
+    }
+
+    static CorrespondenceEntry buildEntry(const Environment& environment, const Vec2f& centre, const Vec2f (&corners)[4], float fromAngle, float toAngle)
+    {
+        CorrespondenceEntry entry{-1, 0, 0};
+        Line rays[8];
+        for (int i = 0; i < 4; i++) {
+            rays[i] = Line(corners[i], corners[i] + Vec2f(cosf(fromAngle), sinf(fromAngle)) * CORRESPONDENCE_RAY_LENGTH);
+            rays[i + 4] = Line(corners[i], corners[i] + Vec2f(cosf(toAngle), sinf(toAngle)) * CORRESPONDENCE_RAY_LENGTH);
+        }
+        int hits[8];
+        float t[8];
+        environment.landmarkSegments.closestHits(rays, 8, hits, t);
+        for (int i = 0; i < 8; i++) {
+            if (hits[i] == -1 || hits[i] != hits[0]) {
+                entry.flags |= CORRESPONDENCE_AMBIGUOUS;
+                break;
+            }
+        }
+        if (!(entry.flags & CORRESPONDENCE_AMBIGUOUS)) entry.landmark = int8_t(hits[0]);
+
+        float centreAngle = 0.5f * (fromAngle + toAngle);
+        Line centreRay(centre, centre + Vec2f(cosf(centreAngle), sinf(centreAngle)) * CORRESPONDENCE_RAY_LENGTH);
+        float centreT;
+        if (environment.landmarkSegments.closestHit(centreRay, centreT) == -1) entry.flags |= CORRESPONDENCE_NO_HIT;
+        else entry.expectedRangeMm = uint16_t(std::min(centreT * CORRESPONDENCE_RAY_LENGTH * 1000.0f + 0.5f, 65535.0f));
+        return entry;
+    }
+
+    void setScale(const CorrespondenceTableHeader& header)
+    {
+        inverseCellSize = 1.0f / header.cellSize;
+        angleBinsPerRadian = header.angleBins / float(2.0 * M_PI);
+    }
+
+    static size_t entryCount(const CorrespondenceTableHeader& header) {return size_t(header.cellsPerSide) * header.cellsPerSide * header.angleBins;}
+
+    MappedGrid<CorrespondenceTableHeader, CorrespondenceEntry> grid;
+    float inverseCellSize = 0.0f;
+    float angleBinsPerRadian = 0.0f;
+};
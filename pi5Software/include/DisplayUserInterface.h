@@ -7,6 +7,7 @@
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
 #include "backends/imgui_impl_opengl3.h"
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -44,6 +45,17 @@ class DisplayUserInterface {
     bool gyroStatus = false;
     bool lidarPositionStatus = false;
     bool lidarHeadingStatus = false;
+    float lidarRevolutionsPerSecond = 0.0f;
+    float lidarPointsPerSecond = 0.0f;
+    bool lidarHealthy = false;
+    std::string lidarHealth = "Stopped";
+    float lidarLatencyMs = 0.0f;
+    int lidarRecoveries = 0;
+    int lidarSkippedFrames = 0; // Only the simulation transport loses frames
+    int lidarTornReads = 0;
+    int lidarRejectedNoReturn = 0; // Summed since the start, see LidarRejections
+    int lidarRejectedLowQuality = 0;
+    int lidarRejectedRangeJump = 0;
 
     explicit DisplayUserInterface(Visibility& pVisibility) : visibility(pVisibility){
         // Create window with graphics context
@@ -143,6 +155,10 @@ class DisplayUserInterface {
             ImGui::TextColored(boolToColor(gyroStatus), "Gyro status");
             ImGui::TextColored(boolToColor(lidarPositionStatus), "LiDAR position status");
             ImGui::TextColored(boolToColor(lidarHeadingStatus), "LiDAR heading status");
+            ImGui::Text("LiDAR: %.1f rev/s %.0f points/s", lidarRevolutionsPerSecond, lidarPointsPerSecond);
+            ImGui::Text("LiDAR rejected: %d no return, %d low quality, %d range jump", lidarRejectedNoReturn, lidarRejectedLowQuality, lidarRejectedRangeJump);
+            ImGui::TextColored(boolToColor(lidarHealthy), "LiDAR health: %s, latency %.0f ms, %d restarts", lidarHealth.c_str(), lidarLatencyMs, lidarRecoveries);
+            if(lidarSkippedFrames > 0 || lidarTornReads > 0) ImGui::Text("LiDAR transport: %d skipped frames, %d torn reads", lidarSkippedFrames, lidarTornReads);
 
             /*
             ImGui::SeparatorText("Lidar");
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "Vec2f.h"
+#include "Line.h"
+#include "LidarPoint.h"
+#include "FastMath.h"
+#include "Environment.h"
+#include "Run_Type.h"
+#include "MappedGrid.h"
+
+// Distance from any point of the arena to the nearest useable landmark, sampled on a grid and interpolated bilinearly
+// Lets a pose be scored against the walls in O(points) without a single ray cast or segment test
+// Unsigned: a sign from the inside of the arena would jump across the gaps where a landmark is not useable (parking)
+// Saved and memory mapped with MappedGrid like the CorrespondenceTable, but building only takes a few milliseconds
+
+#define DISTANCE_FIELD_MAGIC 0x4446545349445257ULL // "WRDISTFD"
+#define DISTANCE_FIELD_VERSION 1
+#define DISTANCE_FIELD_CELL_SIZE 0.01f // 321 x 321 samples with the margin, 400 KB
+#define DISTANCE_FIELD_MARGIN 0.1f     // Around the outer walls, for lidar points measured slightly behind a wall
+
+struct DistanceFieldHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t samplesPerSide;
+    uint32_t landmarkHash;
+    float cellSize;
+    float originX;
+    float originY;
+};
+
+class DistanceField
+{
+public:
+    static std::string defaultPath(enum RUN_TYPE runType, bool parkingObstacle)
+    {
+        return MappedGrid<DistanceFieldHeader, float>::defaultPath("distanceField", runType, parkingObstacle);
+    }
+
+    // Maps the file if it was built for this environment, otherwise builds the field and saves it to the file
+    // An empty path only builds; Always ends with a usable field
+    bool loadOrBuild(const std::string& path, const Environment& environment)
+    {
+        if (!path.empty() && load(path, environment)) {
+            printf("[DISTANCE FIELD] Mapped %s\n", path.c_str());
+            return true;
+        }
+        build(environment);
+        if (!path.empty() && !save(path)) printf("[DISTANCE FIELD] Could not save %s, it is built again on the next start\n", path.c_str());
+        return true;
+    }
+
+    [[nodiscard]] bool isReady() const {return grid.isReady();}
+
+    // Positions outside the grid get the distance of the nearest border sample
+    float distance(const Vec2f& p) const
+    {
+        int index;
+        float fx, fy;
+        locate(p, index, fx, fy);
+        const float* s = samples + index;
+        float bottom = s[0] + (s[1] - s[0]) * fx;
+        float top = s[n] + (s[n + 1] - s[n]) * fx;
+        return bottom + (top - bottom) * fy;
+    }
+
+    // The gradient is the derivative of the bilinear interpolation, constant along each cell edge
+    float distance(const Vec2f& p, Vec2f& gradient) const
+    {
+        int index;
+        float fx, fy;
+        locate(p, index, fx, fy);
+        const float* s = samples + index;
+        float bottom = s[0] + (s[1] - s[0]) * fx;
+        float top = s[n] + (s[n + 1] - s[n]) * fx;
+        float left = s[0] + (s[n] - s[0]) * fy;
+        float right = s[1] + (s[n + 1] - s[1]) * fy;
+        gradient = Vec2f((right - left) * inverseCellSize, (top - bottom) * inverseCellSize);
+        return bottom + (top - bottom) * fy;
+    }
+
+    // Mean of the squared wall distances of the scan at this pose, every point counts at most truncation^2 so obstacles do not dominate
+    // The scan is relative to the position and already rotated by the heading like in Slam, headingOffset rotates it further
+    float score(const LidarScan& scan, const Vec2f& position, float headingOffset, float truncation) const
+    {
+        if (scan.scan.empty()) return truncation * truncation;
+        Vec2f rotation;
+        FastMath::sinCos(headingOffset, rotation.y, rotation.x);
+        float limit = truncation * truncation;
+        float sum = 0.0f;
+        for (const LidarPoint& lp : scan.scan) {
+            Vec2f p = lp.point();
+            float d = distance(Vec2f(position.x + p.x * rotation.x - p.y * rotation.y, position.y + p.x * rotation.y + p.y * rotation.x));
+            sum += std::min(d * d, limit);
+        }
+        return sum / scan.scan.size();
+    }
+
+    void build(const Environment& environment)
+    {
+        DistanceFieldHeader header = makeHeader(environment);
+        setScale(header);
+        float* built = grid.allocate(header, size_t(n) * n);
+
+        std::vector<Line> walls;
+        for (const Landmark& landmark : environment.landmarks) {
+            if (landmark.isUseable) walls.push_back(landmark.line);
+        }
+        for (int y = 0; y < n; y++) {
+            for (int x = 0; x < n; x++) {
+                Vec2f p(header.originX + x * header.cellSize, header.originY + y * header.cellSize);
+                float d = walls.empty() ? 0.0f : INFINITY;
+                for (const Line& wall : walls) d = std::min(d, (p - wall.closestPointOnSegment(p)).length());
+                built[size_t(y) * n + x] = d;
+            }
+        }
+        samples = grid.data();
+    }
+
+    bool save(const std::string& path) const {return grid.save(path, "[DISTANCE FIELD]");}
+
+    bool load(const std::string& path, const Environment& environment)
+    {
+        samples = nullptr;
+        DistanceFieldHeader expected = makeHeader(environment);
+        if (!grid.load(path, expected, size_t(expected.samplesPerSide) * expected.samplesPerSide, "[DISTANCE FIELD]")) return false;
+        setScale(expected);
+        samples = grid.data();
+        return true;
+    }
+
+private:
+    static DistanceFieldHeader makeHeader(const Environment& environment)
+    {
+        DistanceFieldHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = DISTANCE_FIELD_MAGIC;
+        h.version = DISTANCE_FIELD_VERSION;
+        h.cellSize = DISTANCE_FIELD_CELL_SIZE;
+        Vec2f extent = environment.outerTopRight - environment.outerBottomLeft;
+        h.samplesPerSide = uint32_t(ceilf((std::max(extent.x, extent.y) + 2.0f * DISTANCE_FIELD_MARGIN) / h.cellSize)) + 1;
+        h.landmarkHash = environment.landmarkHash();
+        h.originX = environment.outerBottomLeft.x - DISTANCE_FIELD_MARGIN;
+        h.originY = environment.outerBottomLeft.y - DISTANCE_FIELD_MARGIN;
+        return h;
+    }
+
+    // Index of the lower left sample of the cell and the position inside it
+    void locate(const Vec2f& p, int& index, float& fx, float& fy) const
+    {
+        float gx = std::clamp((p.x - originX) * inverseCellSize, 0.0f, maxCoordinate);
+        float gy = std::clamp((p.y - originY) * inverseCellSize, 0.0f, maxCoordinate);
+        int x = std::min(int(gx), n - 2);
+        int y = std::min(int(gy), n - 2);
+        fx = gx - x;
+        fy = gy - y;
+        index = y * n + x;
+    }
+
+    void setScale(const DistanceFieldHeader& header)
+    {
+        n = int(header.samplesPerSide);
+        inverseCellSize = 1.0f / header.cellSize;
+        maxCoordinate = float(n - 1);
+        originX = header.originX;
+        originY = header.originY;
+    }
+
+    MappedGrid<DistanceFieldHeader, float> grid;
+    int n = 0; // Samples per side
+    float inverseCellSize = 0.0f;
+    float maxCoordinate = 0.0f;
+    float originX = 0.0f;
+    float originY = 0.0f;
+    const float* samples = nullptr; // Row major from originX, originY; grid.data() kept next to the scale for the lookups
+};
@@ -25,7 +25,6 @@ public:
 
     int reset();
     int getEncodingData(float& deltaDistance, float& deltaHeading);
-    static float normaliseAngle(float angle);
     
 private:    
     int fd;
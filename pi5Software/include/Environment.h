@@ -1,20 +1,60 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
 
 #include "Run_Type.h"
 #include "Line.h"
 #include "Vec2f.h"
+#include "Vec2fBatch.h"
 
+// A wall of the arena, its geometry is computed once here so the per point work in Slam needs no sqrt, divide or atan2
+// The line is in Hesse normal form: normal.dot(p) == offset for every point p on the infinite line
 class Landmark
 {
 public:
-    explicit Landmark(Line pLine, bool pIsUseable = true) : line(pLine), isUseable(pIsUseable) {}
-    explicit Landmark(Vec2f a, Vec2f b, bool pIsUseable = true) : line(a, b), isUseable(pIsUseable) {}
+    explicit Landmark(Line pLine, bool pIsUseable = true) : line(pLine), isUseable(pIsUseable) {computeGeometry();}
+    explicit Landmark(Vec2f a, Vec2f b, bool pIsUseable = true) : line(a, b), isUseable(pIsUseable) {computeGeometry();}
 
+    // Positive on the side the normal points to (left of start → end), the distance to the infinite line
+    [[nodiscard]] float signedDistance(const Vec2f& p) const {return normal.x * p.x + normal.y * p.y - offset;}
 
-    Line line;
+    // Position along the line, 0 at start and length at end
+    [[nodiscard]] float projection(const Vec2f& p) const {return direction.x * (p.x - line.start.x) + direction.y * (p.y - line.start.y);}
+
+    [[nodiscard]] Vec2f closestPointOnInfinite(const Vec2f& p) const {return p - normal * signedDistance(p);}
+
+    [[nodiscard]] bool inBoundingBox(const Vec2f& p, float margin = 0.0f) const
+    {
+        return p.x >= boundingMin.x - margin && p.x <= boundingMax.x + margin && p.y >= boundingMin.y - margin && p.y <= boundingMax.y + margin;
+    }
+
+    Line line; // Only set through the constructor, the members below are derived from it
     bool isUseable;
+
+    Vec2f direction;   // Unit vector from start to end
+    Vec2f normal;      // Unit normal, the same as line.normal()
+    float offset;      // normal.dot(line.start)
+    float angle;       // Angle of direction in (-PI, PI]
+    float length;
+    Vec2f boundingMin;
+    Vec2f boundingMax;
+
+private:
+    void computeGeometry()
+    {
+        Vec2f delta = line.direction();
+        length = delta.length();
+        direction = length > 0.0f ? delta / length : Vec2f(1.0f, 0.0f);
+        normal = Vec2f(-direction.y, direction.x);
+        offset = normal.dot(line.start);
+        angle = atan2f(direction.y, direction.x);
+        boundingMin = Vec2f(std::min(line.start.x, line.end.x), std::min(line.start.y, line.end.y));
+        boundingMax = Vec2f(std::max(line.start.x, line.end.x), std::max(line.start.y, line.end.y));
+    }
 };
 
 class Environment {
@@ -60,9 +100,30 @@ public:
             landmarks.emplace_back(Landmark(Vec2f(2.0f, 0.0f), Vec2f(2.0f, 0.2f), false));
             landmarks.emplace_back(Landmark(Vec2f(2.0f - parkingObstacleLength, 0.0f), Vec2f(2.0f - parkingObstacleLength, 0.2f), false));
         }
+
+        std::vector<Line> lines;
+        for (const Landmark& landmark : landmarks) lines.push_back(landmark.line);
+        landmarkSegments.assign(lines.data(), lines.size());
+    }
+
+    // FNV-1a of the landmark lines and flags, tables cached in files use it to detect a changed arena
+    [[nodiscard]] uint32_t landmarkHash() const
+    {
+        uint32_t hash = 2166136261u;
+        auto add = [&hash](const void* data, size_t size) {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 16777619u;
+        };
+        for (const Landmark& landmark : landmarks) {
+            add(&landmark.line, sizeof(Line));
+            uint8_t useable = landmark.isUseable;
+            add(&useable, 1);
+        }
+        return hash;
     }
     
     std::vector<Landmark> landmarks;
+    SegmentBatch landmarkSegments; // The landmark lines for ray casts, indices are the same as in landmarks
     Vec2f outerBottomLeft;
     Vec2f outerTopRight;
     Vec2f innerBottomLeft;
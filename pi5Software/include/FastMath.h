@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Angle helpers shared by the sensors, the lidar and the path planning
+// Wrapping is a floorf instead of two fmodf, floorf is a single instruction on the Cortex-A76 so there is no division
+// and no loop, only a compare that catches the rounding at the ends of the range
+namespace FastMath
+{
+    inline constexpr float PI = float(M_PI);
+    inline constexpr float TWO_PI = float(2.0 * M_PI);
+    inline constexpr float INV_TWO_PI = float(1.0 / (2.0 * M_PI));
+
+    // Error bound of atan2 against atan2f, measured over the full circle
+    inline constexpr float ATAN2_MAX_ERROR = 5e-7f;
+
+    // Angle in [0, 2*PI); Exact to float rounding for angles within a few turns
+    inline float wrapAngle(float angle)
+    {
+        float wrapped = angle - TWO_PI * floorf(angle * INV_TWO_PI);
+        return wrapped < TWO_PI ? wrapped : 0.0f; // Tiny negative angles round up to a full turn
+    }
+
+    // Angle in [-PI, PI)
+    inline float wrapAngleSigned(float angle)
+    {
+        float wrapped = angle - TWO_PI * floorf(angle * INV_TWO_PI + 0.5f);
+        if (wrapped < -PI) return wrapped + TWO_PI; // Rounding can leave it a few ulp outside
+        return wrapped < PI ? wrapped : wrapped - TWO_PI;
+    }
+
+    // Shortest signed rotation from b to a, in [-PI, PI)
+    inline float angleDifference(float a, float b) {return wrapAngleSigned(a - b);}
+
+    // Fraction of a turn in [0, 1) from one binary angle (65536 per turn, like the lidar angle_z_q14) to the next in positive direction
+    // The wrap is integer overflow, no fmodf
+    inline float binarySweep(uint16_t from, uint16_t to) {return uint16_t(to - from) * (1.0f / 65536.0f);}
+
+    // Sine and cosine of the same angle in one call, as exact as sinf and cosf
+    inline void sinCos(float angle, float& s, float& c)
+    {
+#ifdef __GLIBC__
+        sincosf(angle, &s, &c); // Shares the argument reduction
+#else
+        s = sinf(angle);
+        c = cosf(angle);
+#endif
+    }
+
+    // Angle of (x, y) in (-PI, PI] like atan2f, 0 for (0, 0)
+    // Octant reduction onto [0, 1] and the polynomial of Abramowitz and Stegun 4.4.49
+    inline float atan2(float y, float x)
+    {
+        float ax = fabsf(x);
+        float ay = fabsf(y);
+        float big = ax > ay ? ax : ay;
+        if (big == 0.0f) return 0.0f;
+        float t = (ax > ay ? ay : ax) / big;
+        float t2 = t * t;
+        float angle = t * (0.9999993329f + t2 * (-0.3332985605f + t2 * (0.1994653599f + t2 * (-0.1390853351f
+                    + t2 * (0.0964200441f + t2 * (-0.0559098861f + t2 * (0.0218612288f + t2 * -0.0040540580f)))))));
+        if (ay > ax) angle = 0.5f * PI - angle;
+        if (x < 0.0f) angle = PI - angle;
+        return y < 0.0f ? -angle : angle;
+    }
+}
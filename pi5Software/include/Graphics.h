@@ -8,6 +8,7 @@
 
 #include "Vec2f.h"
 #include "Line.h"
+#include "Vec2fBatch.h"
 #include "DisplayData.h"
 #include "RGBA.h"
 
@@ -171,12 +172,8 @@ class Graphics {
     }
 
     static void normalisePoints(vector<Vec2f>& points, float maxVal = 4.0f) {
-        for (auto& p : points) {
-            p.x /= maxVal / 2.0f;
-            p.y /= maxVal / 2.0f;
-            p.x -= 0.75;
-            p.y -= 0.75;
-        }
+        // Scale by 2 / maxVal and shift by -0.75 as one batch transform without rotation
+        Vec2fBatch::transform(points.data(), points.data(), points.size(), Vec2f(2.0f / maxVal, 0.0f), Vec2f(-0.75f, -0.75f));
     }
 
     static void appendPointVertex(std::vector<float>& buffer, const Vec2f& p, const RGBA& color = RGBA()) {
@@ -18,9 +18,6 @@ public:
     // Reset the yaw reference 
     int reset();
 
-    // Helper function for normalising angles
-    static float normaliseAngle(float angle);
-
 private:
     int fd = -1;
     bool fdOpen = false;
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#include "SensorLog.h"
+#include "LidarPoint.h"
+
+// Random access to the lidar scans of a memory mapped sensor log, e.g. the corpus made by importLidarTestData
+// Opening only indexes the record headers, the points are decoded from the mapping when a scan is requested
+class LidarCorpus
+{
+public:
+    bool open(const std::string& path)
+    {
+        scans.clear();
+        if (!reader.open(path)) return false;
+        const SensorLogRecord* record;
+        while ((record = reader.next())) {
+            if (isSensorLogScan(record->type)) scans.push_back(record);
+        }
+        return true;
+    }
+
+    void close()
+    {
+        scans.clear();
+        reader.close();
+    }
+
+    [[nodiscard]] size_t size() const {return scans.size();}
+
+    // Decodes scan i into the given scan, reusing its capacity
+    bool getScan(size_t i, LidarScan& scan, float scale = 1.0f, float subtractor = 0.0f) const
+    {
+        if (i >= scans.size()) return false;
+        return SensorLogReader::readScan(scans[i], scan, scale, subtractor);
+    }
+
+private:
+    SensorLogReader reader;
+    std::vector<const SensorLogRecord*> scans;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+
+#include "LidarPoint.h"
+
+// Gating and conversion of the measurements as the device reports them
+// Shared by the hardware backend (sl_lidar_response_measurement_node_hq_t) and the replay of recorded nodes (LidarRawNode),
+// both have the fields angle_z_q14, dist_mm_q2 and quality
+struct LidarNodeFilter
+{
+	uint8_t minQuality = 8;		// Nodes with a lower quality (0-255) are dropped; 0 disables
+	float maxRangeJump = 0.1f;	// A node lying between its neighbours with a jump of more than this (m) to both is a mixed pixel; 0 disables
+	float maxRangeSlope = 10.0f;	// Range change per metre of spacing between neighbours a surface may have, added to maxRangeJump; About 85 degrees incidence
+	bool keepRawNodes = false;	// Also hand out every node before the gating in LidarScan::raw, for the sensor log; Only the hardware backend has nodes
+};
+
+// Device angle_z_q14 (CW, 65536 per turn, 0 pointing backwards) to a binary angle in the robot frame (CCW, 65536 per turn, 0 pointing forward)
+// The wrap around is integer overflow, so the conversion needs no fmodf
+inline uint16_t lidarDeviceToBinaryAngle(uint16_t angleZQ14)
+{
+	return uint16_t(16384u - angleZQ14);
+}
+
+// Converts a node into the robot frame (CCW, 0 pointing forward) and appends it if it is a valid measurement
+template<typename Node>
+inline void appendLidarNode(LidarScan& scan, const Node& node, float time, float scale, float subtractor)
+{
+	float distance = ((node.dist_mm_q2 / 4.0f / 1000.0f) - subtractor) * scale; // First subtract then scale
+	if (distance <= 0) {
+		scan.rejected.noReturn++;
+		return;
+	}
+
+	LidarPoint lp;
+	lp.setBinaryAngle(lidarDeviceToBinaryAngle(node.angle_z_q14));
+	lp.distance = distance;
+	lp.time = time;
+	scan.scan.push_back(lp);
+}
+
+// Drops empty, weak and mixed pixel returns and appends the remaining nodes; timeOf(i) is the capture time of node i
+// The nodes have to be in angular order (sorted or as captured) so neighbours in the array are neighbours in space
+template<typename Node, typename TimeOf>
+void appendGatedLidarNodes(LidarScan& scan, const Node* nodes, size_t count, const LidarNodeFilter& filter, float scale, float subtractor, TimeOf timeOf)
+{
+	// Next node that has a return of sufficient quality, the skipped ones are counted
+	auto nextCandidate = [&](size_t i) {
+		for (; i < count; i++) {
+			if (nodes[i].dist_mm_q2 == 0) scan.rejected.noReturn++;
+			else if (nodes[i].quality < filter.minQuality) scan.rejected.lowQuality++;
+			else break;
+		}
+		return i;
+	};
+
+	// A mixed pixel averages a near and a far surface at an edge, so it lies between its neighbours and far from both
+	// A single return from a thin object is closer than both neighbours and is kept
+	// A wall seen at grazing incidence also changes its range quickly from node to node, the allowed jump grows with the spacing
+	// of the neighbours (range times angular step) so such walls are kept
+	float maxJump = filter.maxRangeJump * 4000.0f; // In the device unit of quarter millimetres
+	const float radiansPerStep = float(2*M_PI / 65536.0);
+	size_t previous = count;
+	size_t current = nextCandidate(0);
+	while (current < count) {
+		size_t next = nextCandidate(current + 1);
+		bool mixed = false;
+		if (maxJump > 0 && previous < count && next < count) {
+			float range = float(nodes[current].dist_mm_q2);
+			float low = float(std::min(nodes[previous].dist_mm_q2, nodes[next].dist_mm_q2));
+			float high = float(std::max(nodes[previous].dist_mm_q2, nodes[next].dist_mm_q2));
+			float step = uint16_t(nodes[next].angle_z_q14 - nodes[previous].angle_z_q14) * 0.5f * radiansPerStep; // Binary angles wrap by overflow
+			float allowedJump = maxJump + filter.maxRangeSlope * range * step;
+			mixed = range > low + allowedJump && range + allowedJump < high;
+		}
+		if (mixed) scan.rejected.rangeJump++;
+		else appendLidarNode(scan, nodes[current], timeOf(current), scale, subtractor);
+		previous = current;
+		current = next;
+	}
+}
+
+// Copies the nodes as they are into scan.raw if the filter asks for it; timeOf(i) is the capture time of node i
+template<typename Node, typename TimeOf>
+void keepRawLidarNodes(LidarScan& scan, const Node* nodes, size_t count, const LidarNodeFilter& filter, TimeOf timeOf)
+{
+	if (!filter.keepRawNodes) return;
+	for (size_t i = 0; i < count; i++) {
+		scan.raw.push_back(LidarRawNode{uint16_t(nodes[i].angle_z_q14), uint8_t(nodes[i].quality), 0, uint32_t(nodes[i].dist_mm_q2), timeOf(i)});
+	}
+}
@@ -2,38 +2,91 @@
 #define LIDARPOINT_H
 
 #include <vector>
+#include <cstdint>
 
 #include "Vec2f.h"
 #include "Line.h"
+#include "FastMath.h"
+#include "TrigTable.h"
 
 class LidarPoint {
     public:
-    float angle; // In Radians!
+    float angle; // In Radians! Change it through setAngle() so the cached direction follows
     float distance;
     int lmIndex = -1; // Index of the corresponding landmark, -1 if no corresponding landmark
+    float time = 0.0f; // Capture time in seconds relative to the end of the scan (LidarScan::timestampUs), <= 0
+    Vec2f direction; // Unit vector of the angle, computed once so point() and getDirection() need no trigonometry
     
-    LidarPoint() : angle(0.0f), distance(0.0f), lmIndex(-1){}
-    LidarPoint(float pAngle, float pDistance, int pLmIndex = -1) : lmIndex(pLmIndex) {
-        angle = normaliseAngle(pAngle);
+    LidarPoint() : angle(0.0f), distance(0.0f), lmIndex(-1), time(0.0f), direction(1.0f, 0.0f){}
+    LidarPoint(float pAngle, float pDistance, int pLmIndex = -1, float pTime = 0.0f) : lmIndex(pLmIndex), time(pTime) {
+        setAngle(FastMath::wrapAngle(pAngle));
         distance = pDistance;
     }
 
-    static float normaliseAngle(float pAngle) {return fmodf(float(fmodf(pAngle, float(2*M_PI))+2*M_PI), 2*M_PI);}
+    void setAngle(float pAngle) {
+        angle = pAngle;
+        FastMath::sinCos(pAngle, direction.y, direction.x);
+    }
+
+    // Angle as binary angle (65536 per turn, like the device angles), the direction comes from the table instead of libm
+    void setBinaryAngle(uint16_t pAngle) {
+        angle = pAngle * float(2*M_PI / 65536.0);
+        direction = TrigTable::directionFromBinary(pAngle);
+    }
 
-    [[nodiscard]] Vec2f getDirection() const {return Vec2f{cosf(angle), sinf(angle)};}
+    [[nodiscard]] Vec2f getDirection() const {return direction;}
+
+    [[nodiscard]] Vec2f point() const {return direction * distance;}
+};
 
-    [[nodiscard]] Vec2f point() const {
-        return Vec2f(cosf(angle) * distance, sinf(angle) * distance);
+// Measurements the acquisition dropped before they reached the scan
+struct LidarRejections {
+    uint32_t noReturn = 0;   // Nothing measured or closer than the subtractor
+    uint32_t lowQuality = 0; // Weak return below the minimum quality
+    uint32_t rangeJump = 0;  // Mixed pixel between a near and a far surface
+
+    [[nodiscard]] uint32_t total() const {return noReturn + lowQuality + rangeJump;}
+
+    LidarRejections& operator+=(const LidarRejections& other) {
+        noReturn += other.noReturn;
+        lowQuality += other.lowQuality;
+        rangeJump += other.rangeJump;
+        return *this;
     }
 };
 
+// A measurement as the device reported it, before the node filter, scale and subtractor; Same fields as the node of the SDK
+struct LidarRawNode {
+    uint16_t angle_z_q14; // CW, 65536 per turn, 0 pointing backwards
+    uint8_t quality;
+    uint8_t reserved;
+    uint32_t dist_mm_q2;  // Quarter millimetres, 0 without a return
+    float time;           // Like LidarPoint::time
+};
+
 class LidarScan {
     public:
     std::vector<LidarPoint> scan;
+    std::vector<LidarRawNode> raw; // Every node the points came from, only filled with LidarNodeFilter::keepRawNodes
+    uint64_t timestampUs = 0; // Capture time of the end of the scan, 0 if unknown
+    int sector = -1; // Index of the angular sector of a streamed partial scan, -1 for a full revolution
+    LidarRejections rejected; // Measurements of this scan that were dropped
 
+    // One 2x2 rotation of the cached directions, the angles are shifted and wrapped without fmodf
     void rotate(float angle) {
+        float delta = FastMath::wrapAngle(angle);
+        float s, c;
+        FastMath::sinCos(delta, s, c);
+        const float fullTurn = float(2*M_PI);
         for(LidarPoint& p : scan) {
-            p.angle = LidarPoint::normaliseAngle(p.angle + angle);
+            float x = p.direction.x;
+            float y = p.direction.y;
+            p.direction.x = x * c - y * s;
+            p.direction.y = x * s + y * c;
+            float rotated = p.angle + delta;
+            if (rotated >= fullTurn) rotated -= fullTurn;
+            else if (rotated < 0.0f) rotated += fullTurn;
+            p.angle = rotated;
         }
     }
 };
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "LidarPoint.h"
+#include "FastMath.h"
+
+// Copy of a scan sorted by angle into fixed 0.5 degree bins, so the points of an angular sector are found without looking at the rest
+// Building is a counting sort, O(points + bins); A query costs O(points in the sector)
+class LidarScanIndex
+{
+public:
+    static constexpr int BIN_COUNT = 720;
+    static constexpr float BIN_WIDTH = float(2.0 * M_PI / BIN_COUNT);
+
+    void build(const LidarScan& scan)
+    {
+        offsets.fill(0);
+        for (const LidarPoint& lp : scan.scan) offsets[binOf(lp.angle) + 1]++;
+        for (int i = 0; i < BIN_COUNT; i++) offsets[i + 1] += offsets[i];
+
+        sorted.resize(scan.scan.size());
+        std::array<uint32_t, BIN_COUNT> next;
+        for (int i = 0; i < BIN_COUNT; i++) next[i] = offsets[i];
+        for (const LidarPoint& lp : scan.scan) sorted[next[binOf(lp.angle)]++] = lp;
+    }
+
+    [[nodiscard]] size_t size() const {return sorted.size();}
+    [[nodiscard]] const std::vector<LidarPoint>& points() const {return sorted;}
+
+    // Calls f for every point with from < angle < to, the sector may wrap around 0 (from > to)
+    // Angles are in radians in [0, 2*PI), like the angles of a LidarPoint
+    template <typename F>
+    void forEachInSector(float from, float to, F&& f) const
+    {
+        if (sorted.empty()) return;
+        if (from > to) {
+            forEachInRange(from, float(2.0 * M_PI), f);
+            forEachInRange(-1.0f, to, f); // Below 0 so a point at exactly 0 is included
+            return;
+        }
+        forEachInRange(from, to, f);
+    }
+
+    // Sector of the given half width around a centre angle, e.g. the left wall window or the camera field of view
+    template <typename F>
+    void forEachAround(float centre, float halfWidth, F&& f) const
+    {
+        forEachInSector(FastMath::wrapAngle(centre - halfWidth), FastMath::wrapAngle(centre + halfWidth), f);
+    }
+
+private:
+    static int binOf(float angle)
+    {
+        int bin = int(angle / BIN_WIDTH);
+        if (bin < 0) return 0;
+        if (bin >= BIN_COUNT) return BIN_COUNT - 1;
+        return bin;
+    }
+
+    // Only the first and the last bin can hold points outside the range, the exact test is only needed there
+    template <typename F>
+    void forEachInRange(float from, float to, F& f) const
+    {
+        int first = binOf(from);
+        int last = binOf(to);
+        for (uint32_t i = offsets[first]; i < offsets[last + 1]; i++) {
+            const LidarPoint& lp = sorted[i];
+            if (i < offsets[first + 1] || i >= offsets[last]) {
+                if (lp.angle <= from || lp.angle >= to) continue;
+            }
+            f(lp);
+        }
+    }
+
+    std::array<uint32_t, BIN_COUNT + 1> offsets{};
+    std::vector<LidarPoint> sorted;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "LidarPoint.h"
+
+#define MAX_SECTOR_AGE_US 250000 // Sectors older than this are left out, about two revolutions
+
+// Keeps the latest sector of every angular range so a full view can be rebuilt whenever a new sector arrives
+class LidarSectorWindow
+{
+public:
+    explicit LidarSectorWindow(int pSectorCount) : sectors(pSectorCount > 0 ? pSectorCount : 1) {}
+
+    void add(const LidarScan& sector)
+    {
+        if (sector.sector < 0 || sector.sector >= (int)sectors.size()) return;
+        sectors[sector.sector] = sector;
+        newest = sector.sector;
+    }
+
+    // Combines the sectors into one scan ending at the newest sector, point times are made relative to its end
+    // The points of the newest sector come first; Returns their count
+    size_t assemble(LidarScan& scan) const
+    {
+        scan.scan.clear();
+        scan.sector = -1;
+        if (newest < 0) return 0;
+
+        const LidarScan& latest = sectors[newest];
+        scan.timestampUs = latest.timestampUs;
+        scan.rejected = latest.rejected;
+        scan.scan.insert(scan.scan.end(), latest.scan.begin(), latest.scan.end());
+        size_t newPointCount = scan.scan.size();
+
+        for (int i = 0; i < (int)sectors.size(); i++) {
+            const LidarScan& sector = sectors[i];
+            if (i == newest || sector.scan.empty()) continue;
+            if (sector.timestampUs > latest.timestampUs || latest.timestampUs - sector.timestampUs > MAX_SECTOR_AGE_US) continue;
+
+            float offset = -float(latest.timestampUs - sector.timestampUs) / 1000000.0f;
+            for (const LidarPoint& lp : sector.scan) {
+                scan.scan.push_back(lp); // Copies the cached direction
+                scan.scan.back().time += offset;
+                scan.scan.back().lmIndex = -1;
+            }
+        }
+        return newPointCount;
+    }
+
+private:
+    std::vector<LidarScan> sectors;
+    int newest = -1;
+};
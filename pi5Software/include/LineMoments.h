@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cmath>
+
+#include "Vec2f.h"
+#include "Line.h"
+
+// Running sums of a point set, enough to fit the total least squares line without keeping the points
+// Doubles because the centred moments are differences of large sums, float loses the few millimetres of wall noise
+struct LineMoments
+{
+    int n = 0;
+    double sx = 0.0, sy = 0.0;
+    double sxx = 0.0, syy = 0.0, sxy = 0.0;
+
+    void add(const Vec2f& p)
+    {
+        n++;
+        sx += p.x;
+        sy += p.y;
+        sxx += double(p.x) * p.x;
+        syy += double(p.y) * p.y;
+        sxy += double(p.x) * p.y;
+    }
+
+    Vec2f centroid() const {return Vec2f(float(sx / n), float(sy / n));}
+
+    // Principal direction of the covariance matrix, the same line as a regression over the points
+    // Line of length 2 through the centroid, empty for less than 2 points
+    Line fit() const
+    {
+        if (n < 2) return Line();
+        double cx = sx / n;
+        double cy = sy / n;
+        double covXX = sxx - sx * cx;
+        double covYY = syy - sy * cy;
+        double covXY = sxy - sx * cy;
+        float theta = 0.5f * float(atan2(2.0 * covXY, covXX - covYY));
+
+        Vec2f c((float)cx, (float)cy);
+        Vec2f direction(cosf(theta), sinf(theta));
+        return Line(c - direction, c + direction);
+    }
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Run_Type.h"
+
+// A header and a flat array of entries that is either built in memory or memory mapped from a file saved before
+// The header identifies what the entries were built for, a file is only mapped if its header is byte for byte the expected one
+// Shared by the CorrespondenceTable and the DistanceField; Header must be memset before it is filled so the padding compares equal
+template<typename Header, typename Entry>
+class MappedGrid
+{
+public:
+    MappedGrid() = default;
+    MappedGrid(const MappedGrid&) = delete;
+    MappedGrid& operator=(const MappedGrid&) = delete;
+    ~MappedGrid() {release();}
+
+    // One file per arena variant, relative to the working directory like the sensor log
+    static std::string defaultPath(const char* name, enum RUN_TYPE runType, bool parkingObstacle)
+    {
+        return std::string(name) + "_" + std::to_string(int(runType)) + (parkingObstacle ? "_parking" : "") + ".bin";
+    }
+
+    [[nodiscard]] bool isReady() const {return entries != nullptr;}
+    [[nodiscard]] const Header& header() const {return fileHeader;}
+    [[nodiscard]] const Entry* data() const {return entries;}
+    [[nodiscard]] size_t size() const {return count;}
+
+    // Drops the old grid and returns count entries in memory to be filled by the caller
+    Entry* allocate(const Header& header, size_t pCount)
+    {
+        release();
+        fileHeader = header;
+        owned.resize(pCount);
+        count = pCount;
+        entries = owned.data();
+        return owned.data();
+    }
+
+    bool save(const std::string& path, const char* tag) const
+    {
+        if (!entries) return false;
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            fprintf(stderr, "%s fopen: %s\n", tag, strerror(errno));
+            return false;
+        }
+        bool ok = fwrite(&fileHeader, sizeof(Header), 1, file) == 1 && fwrite(entries, sizeof(Entry), count, file) == count;
+        fclose(file);
+        return ok;
+    }
+
+    // Maps the file if it starts with expected and holds exactly pCount entries
+    bool load(const std::string& path, const Header& expected, size_t pCount, const char* tag)
+    {
+        release();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) return false; // Not built yet
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(Header)) {
+            ::close(fd);
+            return false;
+        }
+        void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // fd can be closed after mmap
+        if (ptr == MAP_FAILED) {
+            fprintf(stderr, "%s mmap: %s\n", tag, strerror(errno));
+            return false;
+        }
+        if (memcmp(ptr, &expected, sizeof(Header)) != 0 || size_t(st.st_size) != sizeof(Header) + pCount * sizeof(Entry)) {
+            printf("%s %s is for another arena or other parameters, rebuilding\n", tag, path.c_str());
+            munmap(ptr, st.st_size);
+            return false;
+        }
+        mapping = ptr;
+        mappingSize = st.st_size;
+        fileHeader = expected;
+        count = pCount;
+        entries = reinterpret_cast<const Entry*>(static_cast<const uint8_t*>(ptr) + sizeof(Header));
+        return true;
+    }
+
+    void release()
+    {
+        if (mapping) munmap(mapping, mappingSize);
+        mapping = nullptr;
+        mappingSize = 0;
+        entries = nullptr;
+        count = 0;
+        owned.clear();
+    }
+
+private:
+    Header fileHeader{};
+    const Entry* entries = nullptr; // Into the mapping or owned
+    size_t count = 0;
+    std::vector<Entry> owned;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+};
@@ -6,6 +6,7 @@
 #include "Vec2f.h"
 #include "Obstacle.h"
 #include "LidarPoint.h"
+#include "Vec2fBatch.h"
 #include <opencv2/opencv.hpp>
 
 #include "DisplayData.h"
@@ -40,17 +41,23 @@ public:
 
     ~ObstacleDetection() {}
 
-    void feedScan(LidarScan scan, Vec2f estimatedPosition)
+    void feedScan(const LidarScan& scan, Vec2f estimatedPosition)
     {
         float radiusSquared = OBSTACLE_DETECTION_RADIUS * OBSTACLE_DETECTION_RADIUS;
-        for (LidarPoint point : scan.scan)
+        worldPoints.resize(scan.scan.size());
+        for (size_t i = 0; i < scan.scan.size(); i++) worldPoints[i] = scan.scan[i].point() + estimatedPosition;
+
+        // The distances of the whole scan to one obstacle in one call
+        distancesSquared.resize(worldPoints.size());
+        for (Obstacle& possibleObstacle : possibleObstacles)
         {
-            for (Obstacle& possibleObstacle : possibleObstacles)
+            Vec2fBatch::distanceSquared(worldPoints.data(), worldPoints.size(), possibleObstacle.position, distancesSquared.data());
+            for (size_t i = 0; i < worldPoints.size(); i++)
             {
-                if (isInRadiusSquared(point.point() + estimatedPosition, possibleObstacle.position, radiusSquared))
+                if (distancesSquared[i] < radiusSquared)
                 {
                     if (possibleObstacle.count < 999999) possibleObstacle.count++; // Safety against overflow
-                    dpd.appendPoint(point.point() + estimatedPosition, WHITE);
+                    dpd.appendPoint(worldPoints[i], WHITE);
                 }
             }
         }
@@ -64,13 +71,16 @@ public:
         {
             Obstacle* closest = nullptr;
             float shortestSquaredDistance = 16;
+            // Inside the field of view if the angle to the heading is below half the FOV, compared through the cosine so no acosf is needed
+            Vec2f forward(cosf(heading), sinf(heading));
+            static const float cosHalfFov = cosf(HORIZONTAL_CAMERA_FOV / 2.0f);
             for (Obstacle& obstacle : filteredObstacles)
             {
                 if (obstacle.isValid())
                 {
                     Vec2f rel(obstacle.position - position);
-                    float angle = acosf((rel.x * cosf(heading) + rel.y * sinf(heading)) / rel.length());
-                    if (rel.lengthSquared() < shortestSquaredDistance && fabs(angle) < HORIZONTAL_CAMERA_FOV / 2.0f) // The closest obstacle infront of the robot
+                    bool inFov = rel.x * forward.x + rel.y * forward.y > rel.length() * cosHalfFov;
+                    if (rel.lengthSquared() < shortestSquaredDistance && inFov) // The closest obstacle infront of the robot
                     {
                         shortestSquaredDistance = rel.lengthSquared();
                         closest = &obstacle;
@@ -217,12 +227,8 @@ public:
     std::vector<Obstacle> possibleObstacles;
 
 protected:
-    bool isInRadiusSquared(Vec2f positionA, Vec2f positionB, float radiusSquared)
-    {
-        float distanceSquared = Vec2f(positionB-positionA).lengthSquared();
-        if (distanceSquared < radiusSquared) return true;
-        return false;
-    }
+    std::vector<Vec2f> worldPoints;    // Scratch of feedScan, kept so it is only allocated once
+    std::vector<float> distancesSquared;
 
     Vec2f rotate90(const Vec2f& p, const Vec2f& center) {
         float x = p.x - center.x;
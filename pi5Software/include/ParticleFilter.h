@@ -0,0 +1,299 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <random>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <algorithm>
+
+#include "Vec2f.h"
+#include "LidarPoint.h"
+#include "Environment.h"
+#include "DistanceField.h"
+#include "FastMath.h"
+
+#define PARTICLE_FILTER_MAX_PARTICLES 4096
+#define PARTICLE_FILTER_MAX_BEAMS 256
+
+struct Particle {
+    Vec2f position;
+    float heading;
+    float logWeight; // Log likelihood of the last scan, turned into the weight when resampling
+};
+
+struct ParticlePose {
+    Vec2f position;
+    float heading;
+    float positionSpread; // Weighted standard deviation of the particle positions
+    float effectiveParticles;
+};
+
+// Monte Carlo localisation against the DistanceField
+// Odometry moves every particle at once, its noise is added before the next scan is weighed, scaled by the motion since the last scan
+// The particles are weighed in parallel: the calling thread and threadCount - 1 workers each take an equal slice
+// Both particle buffers are allocated once for PARTICLE_FILTER_MAX_PARTICLES and swapped by the resampling, a frame does not allocate
+class ParticleFilter
+{
+public:
+    ParticleFilter() = default;
+    ParticleFilter(const ParticleFilter&) = delete;
+    ParticleFilter& operator=(const ParticleFilter&) = delete;
+    ~ParticleFilter() {stopWorkers();}
+
+    int particleCount = 1000;
+    int threadCount = 3;                 // Of the four Cortex-A76 cores, one is left to the lidar, camera and guidance threads
+    int beamStride = 3;                  // Every third point is weighed, at most PARTICLE_FILTER_MAX_BEAMS
+    float scoreTruncation = 0.2f;        // A point further from any wall is an obstacle or a wrong pose, it costs no more than this
+    float scoreSigma = 0.03f;            // Wall distance noise of a correct pose
+    float likelihoodPoints = 30.0f;      // The points of a scan are not independent, the mean score counts like this many points
+    float distanceNoise = 0.05f;         // Standard deviation per metre driven
+    float headingNoise = 0.05f;          // Standard deviation per radian turned
+    float minimumPositionNoise = 0.005f; // Per scan, also while standing so a wrong pose can still move
+    float minimumHeadingNoise = 0.003f;
+    float randomParticleRatio = 0.01f;   // Replaced by random positions in the arena at every resampling to recover from a wrong pose
+    float randomHeadingSpread = 0.2f;    // Around the mean heading, the arena looks the same turned by 90 degrees so the gyro has to decide
+    float resampleThreshold = 0.5f;      // Resample when the effective particle count falls below this share
+
+    [[nodiscard]] bool isInitialised() const {return initialised;}
+
+    // Spreads the particles around the pose, starts the workers the first time
+    void initialise(const Vec2f& position, float heading, float positionSpread, float headingSpread, const Environment& environment)
+    {
+        count = std::clamp(particleCount, 1, PARTICLE_FILTER_MAX_PARTICLES);
+        if (particles.empty()) {
+            particles.resize(PARTICLE_FILTER_MAX_PARTICLES);
+            resampled.resize(PARTICLE_FILTER_MAX_PARTICLES);
+            beams.reserve(PARTICLE_FILTER_MAX_BEAMS);
+        }
+        arenaMin = environment.outerBottomLeft;
+        arenaMax = environment.outerTopRight;
+        blockedMin = environment.innerBottomLeft;
+        blockedMax = environment.innerTopRight;
+        std::normal_distribution<float> gauss(0.0f, 1.0f);
+        for (int i = 0; i < count; i++) {
+            Particle& p = particles[i];
+            p.position = clampToArena(position + Vec2f(gauss(random), gauss(random)) * positionSpread);
+            p.heading = FastMath::wrapAngle(heading + gauss(random) * headingSpread);
+            p.logWeight = 0.0f;
+        }
+        movedDistance = 0.0f;
+        turnedAngle = 0.0f;
+        startWorkers();
+        initialised = true;
+    }
+
+    // Odometry since the last call, from updateEncoder and updateGyro
+    void predict(float deltaDistance, float deltaHeading)
+    {
+        if (!initialised) return;
+        for (int i = 0; i < count; i++) {
+            Particle& p = particles[i];
+            p.heading += deltaHeading;
+            if (deltaDistance != 0.0f) {
+                Vec2f direction;
+                FastMath::sinCos(p.heading, direction.y, direction.x);
+                p.position += direction * deltaDistance;
+            }
+        }
+        movedDistance += fabsf(deltaDistance);
+        turnedAngle += fabsf(deltaHeading);
+    }
+
+    // The scan is in the robot frame, not rotated by any heading; Returns the weighted mean pose
+    std::optional<ParticlePose> update(const LidarScan& scan, const DistanceField& field)
+    {
+        if (!initialised || !field.isReady()) return std::nullopt;
+        beams.clear();
+        for (size_t i = 0; i < scan.scan.size() && beams.size() < PARTICLE_FILTER_MAX_BEAMS; i += std::max(beamStride, 1)) beams.push_back(scan.scan[i].point());
+        if (beams.empty()) return std::nullopt;
+
+        diffuse();
+        distanceField = &field;
+        weighAll();
+        distanceField = nullptr;
+
+        // Weights relative to the best particle so exp does not underflow for all of them
+        float bestLogWeight = -INFINITY;
+        for (int i = 0; i < count; i++) bestLogWeight = std::max(bestLogWeight, particles[i].logWeight);
+        double sum = 0.0;
+        double sumSquared = 0.0;
+        for (int i = 0; i < count; i++) {
+            float w = expf(particles[i].logWeight - bestLogWeight);
+            particles[i].logWeight = w; // From here on the plain weight
+            sum += w;
+            sumSquared += double(w) * w;
+        }
+        ParticlePose pose = mean(sum);
+        pose.effectiveParticles = float(sum * sum / sumSquared);
+        if (pose.effectiveParticles < resampleThreshold * count) resample(sum, pose.heading);
+        else for (int i = 0; i < count; i++) particles[i].logWeight = logf(particles[i].logWeight / float(sum)); // Carried into the next scan
+        return pose;
+    }
+
+private:
+    // Odometry noise of the motion since the last scan
+    void diffuse()
+    {
+        float positionSigma = std::max(minimumPositionNoise, distanceNoise * movedDistance);
+        float headingSigma = std::max(minimumHeadingNoise, headingNoise * turnedAngle);
+        std::normal_distribution<float> gauss(0.0f, 1.0f);
+        for (int i = 0; i < count; i++) {
+            Particle& p = particles[i];
+            p.position = clampToArena(p.position + Vec2f(gauss(random), gauss(random)) * positionSigma);
+            p.heading = FastMath::wrapAngle(p.heading + gauss(random) * headingSigma);
+        }
+        movedDistance = 0.0f;
+        turnedAngle = 0.0f;
+    }
+
+    void weighSlice(int begin, int end)
+    {
+        const float limit = scoreTruncation * scoreTruncation;
+        const float scale = likelihoodPoints / (2.0f * scoreSigma * scoreSigma * beams.size());
+        for (int i = begin; i < end; i++) {
+            Particle& p = particles[i];
+            Vec2f rotation;
+            FastMath::sinCos(p.heading, rotation.y, rotation.x);
+            float sum = 0.0f;
+            for (const Vec2f& b : beams) {
+                float d = distanceField->distance(Vec2f(p.position.x + b.x * rotation.x - b.y * rotation.y, p.position.y + b.x * rotation.y + b.y * rotation.x));
+                sum += std::min(d * d, limit);
+            }
+            p.logWeight += -sum * scale;
+        }
+    }
+
+    int sliceBegin(int slice) const {return int(int64_t(count) * slice / activeThreads);}
+
+    void weighAll()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingWorkers = activeThreads - 1;
+            generation++;
+        }
+        wake.notify_all();
+        weighSlice(sliceBegin(0), sliceBegin(1));
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] {return pendingWorkers == 0;});
+    }
+
+    void workerLoop(int slice)
+    {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] {return stopping || generation != seen;});
+                if (stopping) return;
+                seen = generation;
+            }
+            weighSlice(sliceBegin(slice), sliceBegin(slice + 1));
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pendingWorkers--;
+            }
+            done.notify_one();
+        }
+    }
+
+    void startWorkers()
+    {
+        if (!workers.empty()) return;
+        activeThreads = std::max(threadCount, 1);
+        for (int slice = 1; slice < activeThreads; slice++) workers.emplace_back(&ParticleFilter::workerLoop, this, slice);
+    }
+
+    void stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers) worker.join();
+        workers.clear();
+    }
+
+    // Plain weights in logWeight, sum is their total
+    ParticlePose mean(double sum) const
+    {
+        double x = 0.0, y = 0.0, c = 0.0, s = 0.0;
+        for (int i = 0; i < count; i++) {
+            const Particle& p = particles[i];
+            Vec2f direction;
+            FastMath::sinCos(p.heading, direction.y, direction.x);
+            x += p.logWeight * p.position.x;
+            y += p.logWeight * p.position.y;
+            c += p.logWeight * direction.x;
+            s += p.logWeight * direction.y;
+        }
+        ParticlePose pose;
+        pose.position = Vec2f(float(x / sum), float(y / sum));
+        pose.heading = FastMath::wrapAngle(FastMath::atan2(float(s), float(c))); // Circular mean
+        double spread = 0.0;
+        for (int i = 0; i < count; i++) spread += particles[i].logWeight * (particles[i].position - pose.position).lengthSquared();
+        pose.positionSpread = sqrtf(float(spread / sum));
+        return pose;
+    }
+
+    // Low variance resampling: one random offset and count equally spaced pointers into the cumulative weights
+    void resample(double sum, float meanHeading)
+    {
+        int randomCount = int(randomParticleRatio * count);
+        int keep = count - randomCount;
+        double step = sum / keep;
+        double pointer = std::uniform_real_distribution<double>(0.0, step)(random);
+        double cumulative = particles[0].logWeight;
+        int source = 0;
+        for (int i = 0; i < keep; i++) {
+            while (pointer > cumulative && source < count - 1) cumulative += particles[++source].logWeight;
+            resampled[i] = particles[source];
+            resampled[i].logWeight = 0.0f;
+            pointer += step;
+        }
+        std::uniform_real_distribution<float> x(arenaMin.x, arenaMax.x);
+        std::uniform_real_distribution<float> y(arenaMin.y, arenaMax.y);
+        std::normal_distribution<float> gauss(0.0f, 1.0f);
+        for (int i = keep; i < count; i++) {
+            Vec2f position;
+            do position = Vec2f(x(random), y(random)); while (inBlocked(position));
+            resampled[i] = Particle{position, FastMath::wrapAngle(meanHeading + gauss(random) * randomHeadingSpread), 0.0f};
+        }
+        particles.swap(resampled);
+    }
+
+    bool inBlocked(const Vec2f& p) const {return p.x > blockedMin.x && p.x < blockedMax.x && p.y > blockedMin.y && p.y < blockedMax.y;}
+
+    Vec2f clampToArena(Vec2f p) const
+    {
+        p.x = std::clamp(p.x, arenaMin.x, arenaMax.x);
+        p.y = std::clamp(p.y, arenaMin.y, arenaMax.y);
+        return p;
+    }
+
+    std::vector<Particle> particles; // Pool of PARTICLE_FILTER_MAX_PARTICLES, the first count are used
+    std::vector<Particle> resampled;
+    std::vector<Vec2f> beams;        // The weighed points of the current scan in the robot frame
+    int count = 0;
+    bool initialised = false;
+    float movedDistance = 0.0f;
+    float turnedAngle = 0.0f;
+    Vec2f arenaMin, arenaMax;
+    Vec2f blockedMin, blockedMax;    // The inner area, random particles are not put there
+    std::mt19937 random{12345};
+    const DistanceField* distanceField = nullptr; // Only set while the workers weigh
+
+    std::vector<std::thread> workers;
+    int activeThreads = 1;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    int pendingWorkers = 0;
+    bool stopping = false;
+};
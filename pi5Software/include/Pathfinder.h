@@ -7,6 +7,7 @@
 #include <iostream>
 
 #include "Vec2f.h"
+#include "FastMath.h"
 #include "Waypoint.h"
 #include "Obstacle.h"
 #include "GuidanceData.h"
@@ -143,7 +144,7 @@ public:
 
     void update(Vec2f position, float heading, std::vector<Obstacle> obstacles, GuidanceData& guidanceData);
     
-    void filterObstacles(std::vector<Obstacle> obstacles,  std::vector<Obstacle>& output);
+    void filterObstacles(const std::vector<Obstacle>& obstacles,  std::vector<Obstacle>& output);
     
     bool getSideObstacle(std::vector<Obstacle> obstacles, int sideIndex, Obstacle& obstacle);
 
@@ -258,11 +259,6 @@ private:
 
     void initPaths();
 
-    float normaliseAngle(float angle)
-    {
-        return fmodf(fmodf(angle, 2.0f*M_PI)+2.0f*M_PI, 2.0f*M_PI);
-    }
-
     void turnWrapper(std::vector<Waypoint>& output)
     {
         if (output.size() >= 2)
@@ -286,8 +282,8 @@ private:
             wp2.heading += M_PI;
         }
 
-        wp1.heading = normaliseAngle(wp1.heading);
-        wp2.heading = normaliseAngle(wp2.heading);
+        wp1.heading = FastMath::wrapAngle(wp1.heading);
+        wp2.heading = FastMath::wrapAngle(wp2.heading);
 
         Line n1(wp1.point, wp1.point + Vec2f(cosf(wp1.heading+M_PI/2.0f), sinf(wp1.heading+M_PI/2.0f)));
         Line n2(wp2.point, wp2.point + Vec2f(cosf(wp2.heading+M_PI/2.0f), sinf(wp2.heading+M_PI/2.0f)));
@@ -296,7 +292,7 @@ private:
         Line l2(wp2.point, wp2.point + Vec2f(cosf(wp2.heading), sinf(wp2.heading)));
 
         std::optional<Vec2f> center;
-        if (normaliseAngle(wp1.heading+M_PI) > normaliseAngle(wp2.heading+0.05) || normaliseAngle(wp1.heading+M_PI) < normaliseAngle(wp2.heading-0.05))
+        if (FastMath::wrapAngle(wp1.heading+M_PI) > FastMath::wrapAngle(wp2.heading+0.05) || FastMath::wrapAngle(wp1.heading+M_PI) < FastMath::wrapAngle(wp2.heading-0.05))
         {
             center = Line::intersectionInfinite(n1, n2);
         }
@@ -331,8 +327,8 @@ private:
             ccw = false;
         }
 
-        if (ccw) sectionSize = normaliseAngle(atan2f(rel1.x, rel1.y) - atan2f(rel2.x, rel2.y)) / (2.0f*M_PI);
-        else sectionSize = normaliseAngle(atan2f(rel2.x, rel2.y) - atan2f(rel1.x, rel1.y)) / (2.0f*M_PI);
+        if (ccw) sectionSize = FastMath::wrapAngle(atan2f(rel1.x, rel1.y) - atan2f(rel2.x, rel2.y)) / (2.0f*M_PI);
+        else sectionSize = FastMath::wrapAngle(atan2f(rel2.x, rel2.y) - atan2f(rel1.x, rel1.y)) / (2.0f*M_PI);
 
         Waypoint wp(wp2);
         wp.point = wp1.point;
@@ -344,14 +340,14 @@ private:
         if (!ccw) angle = -angle;
         for (int i = 0; i < interpolationCount; i++)
         {
-            float middleHeading = normaliseAngle(wp.heading + angle/2.0f);
+            float middleHeading = FastMath::wrapAngle(wp.heading + angle/2.0f);
             wp.heading += angle;
-            wp.heading = normaliseAngle(wp.heading);
+            wp.heading = FastMath::wrapAngle(wp.heading);
 
             wp.point += Vec2f(cosf(middleHeading), sinf(middleHeading)) * distance;
 
             Waypoint copy = wp;
-            if (wp2.reverse) copy.heading = fmodf(copy.heading + M_PI, 2.0f*M_PI); // Return with heading facing the right way again
+            if (wp2.reverse) copy.heading = FastMath::wrapAngle(copy.heading + M_PI); // Return with heading facing the right way again
             output.push_back(copy);
         }
 
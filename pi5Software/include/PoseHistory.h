@@ -0,0 +1,77 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+
+#include "Vec2f.h"
+
+struct StampedPose
+{
+    uint64_t timestampUs = 0;
+    Vec2f position{0.0f, 0.0f};
+    float heading = 0.0f;
+};
+
+// Ring buffer of the odometry poses of the last few hundred milliseconds
+// Used to look up where the robot was when a lidar point was captured
+class PoseHistory
+{
+public:
+    static constexpr size_t CAPACITY = 128;
+
+    void push(uint64_t timestampUs, const Vec2f& position, float heading)
+    {
+        // Keep the history monotonic, a sample with the same time stamp replaces the last one
+        if (count > 0 && timestampUs <= poses[newestIndex()].timestampUs) {
+            if (timestampUs < poses[newestIndex()].timestampUs) return;
+            poses[newestIndex()] = StampedPose{timestampUs, position, heading};
+            return;
+        }
+        poses[head] = StampedPose{timestampUs, position, heading};
+        head = (head + 1) % CAPACITY;
+        if (count < CAPACITY) count++;
+    }
+
+    void clear() {head = 0; count = 0;}
+    size_t size() const {return count;}
+
+    // Linearly interpolated pose at the given time; Returns nullopt if the time is older than the history
+    // Times after the newest sample return the newest pose, odometry is polled far more often than the lidar
+    std::optional<StampedPose> at(uint64_t timestampUs) const
+    {
+        if (count == 0) return std::nullopt;
+        const StampedPose& oldest = poses[(head + CAPACITY - count) % CAPACITY];
+        const StampedPose& newest = poses[newestIndex()];
+        if (timestampUs < oldest.timestampUs) return std::nullopt;
+        if (timestampUs >= newest.timestampUs) return newest;
+
+        // Walk back from the newest sample, lookups are almost always for the last revolution
+        for (size_t i = 0; i + 1 < count; i++) {
+            const StampedPose& b = poses[(head + CAPACITY - 1 - i) % CAPACITY];
+            const StampedPose& a = poses[(head + CAPACITY - 2 - i) % CAPACITY];
+            if (timestampUs < a.timestampUs) continue;
+
+            float t = float(timestampUs - a.timestampUs) / float(b.timestampUs - a.timestampUs);
+            float deltaHeading = b.heading - a.heading;
+            if (deltaHeading > M_PI) deltaHeading -= 2.0f * M_PI;
+            else if (deltaHeading < -M_PI) deltaHeading += 2.0f * M_PI;
+
+            StampedPose pose;
+            pose.timestampUs = timestampUs;
+            pose.position = a.position + (b.position - a.position) * t;
+            pose.heading = a.heading + deltaHeading * t;
+            return pose;
+        }
+        return std::nullopt;
+    }
+
+private:
+    size_t newestIndex() const {return (head + CAPACITY - 1) % CAPACITY;}
+
+    std::array<StampedPose, CAPACITY> poses;
+    size_t head = 0;
+    size_t count = 0;
+};
@@ -54,8 +54,6 @@ public:
     void invert();
 
 protected:
-    static float normaliseAngle(float angle);
-
     bool inverted;
     float currentAngle;
     float angleRange;
@@ -20,6 +20,10 @@
 #include "Camera.h"
 #include "Run_Type.h"
 #include "Slam.h"
+#include "PoseHistory.h"
+#include "LidarSectorWindow.h"
+#include "SensorLog.h"
+#include "DistanceField.h"
 
 class RobotSystem{
 	public:
@@ -31,12 +35,14 @@ class RobotSystem{
 	std::chrono::high_resolution_clock::time_point initTime;
 	std::chrono::high_resolution_clock::time_point startTime;
 	Environment environment;
+	DistanceField distanceField; // Wall distances of environment for scoring poses, mapped from its file or built at startup
 	GuidanceData guidanceData;
 	ObstacleDetection obstacleDetection;
 	Pathfinder pathfinder;
 	enum RUN_DIRECTION runDirection;
 	Slam slam;
 	Slam initSlam; // Slam used for initial pose estimation
+	SensorLogWriter sensorLog; // Only open while the course is run with RECORD_SENSOR_LOG
 
 #ifndef OPENING_RUN
 	static constexpr enum RUN_TYPE runType = RUN_TYPE_OBSTACLE_RUN;
@@ -55,17 +61,59 @@ class RobotSystem{
 	static constexpr bool doUnparking = true;
 #endif
 
+#ifndef LIDAR_SECTOR_STREAMING
+	static constexpr int lidarSectorCount = 0;
+#else
+	static constexpr int lidarSectorCount = 4; // 90 degree sectors
+#endif
+
+#ifndef RECORD_SENSOR_LOG
+	static constexpr bool recordSensorLog = false;
+#else
+	static constexpr bool recordSensorLog = true;
+#endif
+
+#ifndef SLAM_CORRESPONDENCE_TABLE
+	static constexpr bool useCorrespondenceTable = false;
+#else
+	static constexpr bool useCorrespondenceTable = true;
+#endif
+
+#ifndef SLAM_POSE_ICP
+	static constexpr bool useJointPoseEstimate = false;
+#else
+	static constexpr bool useJointPoseEstimate = true;
+#endif
+
+#ifndef SLAM_PARTICLE_FILTER
+	static constexpr bool useParticleFilter = false;
+#else
+	static constexpr bool useParticleFilter = true;
+#endif
+
 	static constexpr float length = 0.16f;
 
 	// Pose
 	float heading;
 	Vec2f position;
+	// The same odometry without the lidar corrections, a correction inside a revolution would look like motion to the de-skewing
+	float odometryHeading;
+	Vec2f odometryPosition;
+	PoseHistory poseHistory; // Odometry poses used to de-skew lidar scans, in the frame of odometryPosition and odometryHeading
 
 	// Actuators
 	GpioController gpioController;
 
 	// Sensors
 	Lidar lidar;
+	LidarSectorWindow lidarSectorWindow;
+	// Frame buffers of updateLidar, kept between frames so they only grow during the first scans
+	LidarScan lidarFrame;
+	LidarScan lidarSectorFrame;
+	LidarScan useableFrame;
+	LidarScan newPointsFrame;
+	std::vector<Obstacle> obstacleFrame;
+	std::vector<Obstacle> filteredObstacleFrame;
 	EncoderController encoderController;
 	Gyro gyro;
 	Camera camera;
@@ -75,7 +123,8 @@ class RobotSystem{
 		encoderController(gpioController),
 		gyro(),
 		camera(),
-		lidar(1.0f, 0.3f),
+		lidar(1.0f, 0.3f, lidarSectorCount),
+		lidarSectorWindow(lidarSectorCount),
 		gp(1000,1000, BLACK),
 		displayUI(visibility),
 		environment(length, runType, parkingObstacle),
@@ -86,8 +135,14 @@ class RobotSystem{
 		slam(),
 		initSlam(),
 		position(0.0f, 0.0f),
+		odometryHeading(0.0f),
+		odometryPosition(0.0f, 0.0f),
 		runDirection(RUN_DIRECTION_CCW),
 		obstacleDetection(),
 		pathfinder(length, runType, parkingObstacle)
-	{}
+	{
+		lidar.nodeFilter.keepRawNodes = recordSensorLog; // The log holds the nodes before the gating
+		distanceField.loadOrBuild(DistanceField::defaultPath(runType, parkingObstacle), environment);
+		if (useCorrespondenceTable) slam.buildCorrespondenceTable(environment, CorrespondenceTable::defaultPath(runType, parkingObstacle));
+	}
 };
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "LidarPoint.h"
+#include "LidarNodes.h"
+
+// Append-only binary log of the sensor data of a run, used to replay a run offline
+// Layout: SensorLogFileHeader followed by records, every record is a SensorLogRecord followed by its payload
+// Records are padded to 8 bytes so the file can be memory mapped and read in place
+// A record cut off by a crash or power loss at the end of the file is ignored by the reader
+
+#define SENSOR_LOG_MAGIC 0x474F4C4F52570000ULL // "\0\0WROLOG"
+#define SENSOR_LOG_VERSION 1
+
+enum SENSOR_LOG_RECORD_TYPE : uint32_t {
+    SENSOR_LOG_LIDAR_SCAN = 1, // SensorLogScan followed by pointCount SensorLogPoint, distances before scale and subtractor
+    SENSOR_LOG_GYRO = 2,       // SensorLogGyro
+    SENSOR_LOG_ENCODER = 3,    // SensorLogEncoder
+    SENSOR_LOG_CAMERA = 4,     // No payload, the time stamp of the grabbed frame
+    SENSOR_LOG_LIDAR_NODES = 5, // SensorLogScan followed by pointCount LidarRawNode, every node as the device reported it before the node filter
+};
+
+// A scan is logged as nodes if the lidar kept them (the hardware backend with LidarNodeFilter::keepRawNodes)
+// Else as the points that passed the node filter of the backend, e.g. in the simulation
+inline bool isSensorLogScan(uint32_t type) {return type == SENSOR_LOG_LIDAR_SCAN || type == SENSOR_LOG_LIDAR_NODES;}
+
+struct SensorLogFileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct SensorLogRecord {
+    uint32_t type;
+    uint32_t size;        // Payload size in bytes without padding
+    uint64_t timestampUs; // steadyTimestampUs() of the sample
+};
+
+struct SensorLogScan {
+    uint32_t pointCount;
+    int32_t sector;       // Sector index in streaming mode, -1 for a full revolution
+};
+
+struct SensorLogPoint {
+    float angle;
+    float distance;
+    float time;
+};
+
+static_assert(sizeof(LidarRawNode) == 12, "LidarRawNode is stored as it is");
+
+struct SensorLogGyro {
+    float deltaHeading;
+    uint32_t reserved;
+};
+
+struct SensorLogEncoder {
+    float deltaDistance;
+    float deltaHeading;
+};
+
+static constexpr size_t sensorLogPadded(size_t size) {return (size + 7) & ~size_t(7);}
+
+class SensorLogWriter
+{
+public:
+    ~SensorLogWriter() {close();}
+
+    // Creates the file or appends to it if it is a log already
+    bool open(const std::string& path)
+    {
+        close();
+        file = fopen(path.c_str(), "ab");
+        if (!file) {
+            perror("[SENSOR LOG] fopen");
+            return false;
+        }
+        if (ftell(file) == 0) {
+            SensorLogFileHeader header{SENSOR_LOG_MAGIC, SENSOR_LOG_VERSION, 0};
+            fwrite(&header, sizeof(header), 1, file);
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (!file) return;
+        fclose(file);
+        file = nullptr;
+    }
+
+    bool isOpen() const {return file != nullptr;}
+
+    // The raw nodes of the scan if the lidar kept them, else the points with the scale and subtractor undone
+    void appendScan(const LidarScan& scan, float scale, float subtractor)
+    {
+        if (!file) return;
+        if (!scan.raw.empty()) {
+            SensorLogScan header{uint32_t(scan.raw.size()), scan.sector};
+            size_t size = sizeof(header) + scan.raw.size() * sizeof(LidarRawNode);
+            writeRecordHeader(SENSOR_LOG_LIDAR_NODES, size, scan.timestampUs);
+            fwrite(&header, sizeof(header), 1, file);
+            fwrite(scan.raw.data(), sizeof(LidarRawNode), scan.raw.size(), file);
+            writePadding(size);
+            return;
+        }
+        SensorLogScan header{uint32_t(scan.scan.size()), scan.sector};
+        writeRecordHeader(SENSOR_LOG_LIDAR_SCAN, sizeof(header) + scan.scan.size() * sizeof(SensorLogPoint), scan.timestampUs);
+        fwrite(&header, sizeof(header), 1, file);
+        for (const LidarPoint& lp : scan.scan) {
+            SensorLogPoint point{lp.angle, lp.distance / scale + subtractor, lp.time};
+            fwrite(&point, sizeof(point), 1, file);
+        }
+        writePadding(sizeof(header) + scan.scan.size() * sizeof(SensorLogPoint));
+    }
+
+    void appendGyro(uint64_t timestampUs, float deltaHeading)
+    {
+        SensorLogGyro gyro{deltaHeading, 0};
+        appendRecord(SENSOR_LOG_GYRO, timestampUs, &gyro, sizeof(gyro));
+    }
+
+    void appendEncoder(uint64_t timestampUs, float deltaDistance, float deltaHeading)
+    {
+        SensorLogEncoder encoder{deltaDistance, deltaHeading};
+        appendRecord(SENSOR_LOG_ENCODER, timestampUs, &encoder, sizeof(encoder));
+    }
+
+    void appendCamera(uint64_t timestampUs) {appendRecord(SENSOR_LOG_CAMERA, timestampUs, nullptr, 0);}
+
+private:
+    void appendRecord(uint32_t type, uint64_t timestampUs, const void* payload, size_t size)
+    {
+        if (!file) return;
+        writeRecordHeader(type, size, timestampUs);
+        if (size > 0) fwrite(payload, size, 1, file);
+        writePadding(size);
+    }
+
+    void writeRecordHeader(uint32_t type, size_t size, uint64_t timestampUs)
+    {
+        SensorLogRecord record{type, uint32_t(size), timestampUs};
+        fwrite(&record, sizeof(record), 1, file);
+    }
+
+    void writePadding(size_t size)
+    {
+        static const uint8_t zeros[8] = {};
+        size_t padding = sensorLogPadded(size) - size;
+        if (padding > 0) fwrite(zeros, padding, 1, file);
+    }
+
+    FILE* file = nullptr;
+};
+
+// Walks the records of a memory mapped log in order
+class SensorLogReader
+{
+public:
+    ~SensorLogReader() {close();}
+
+    bool open(const std::string& path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            perror("[SENSOR LOG] open");
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(SensorLogFileHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // fd can be closed after mmap
+        if (ptr == MAP_FAILED) {
+            perror("[SENSOR LOG] mmap");
+            return false;
+        }
+        data = static_cast<const uint8_t*>(ptr);
+        size = st.st_size;
+
+        const SensorLogFileHeader* header = reinterpret_cast<const SensorLogFileHeader*>(data);
+        if (header->magic != SENSOR_LOG_MAGIC || header->version != SENSOR_LOG_VERSION) {
+            fprintf(stderr, "[SENSOR LOG] %s is not a sensor log of version %d\n", path.c_str(), SENSOR_LOG_VERSION);
+            close();
+            return false;
+        }
+        rewind();
+        return true;
+    }
+
+    void close()
+    {
+        if (!data) return;
+        munmap(const_cast<uint8_t*>(data), size);
+        data = nullptr;
+        size = 0;
+    }
+
+    void rewind() {offset = sizeof(SensorLogFileHeader);}
+
+    // Next complete record; Returns nullptr at the end of the log
+    const SensorLogRecord* next()
+    {
+        if (!data || offset + sizeof(SensorLogRecord) > size) return nullptr;
+        const SensorLogRecord* record = reinterpret_cast<const SensorLogRecord*>(data + offset);
+        size_t end = offset + sizeof(SensorLogRecord) + sensorLogPadded(record->size);
+        if (end > size) return nullptr; // Cut off
+        offset = end;
+        return record;
+    }
+
+    static const void* payload(const SensorLogRecord* record) {return record + 1;}
+
+    // Decodes a lidar record into the scan with the scale and subtractor applied like the lidar backends do
+    // Recorded nodes go through the filter like in the hardware backend, recorded points already passed it
+    static bool readScan(const SensorLogRecord* record, LidarScan& scan, float scale, float subtractor, const LidarNodeFilter& filter = LidarNodeFilter())
+    {
+        if (!isSensorLogScan(record->type) || record->size < sizeof(SensorLogScan)) return false;
+        const SensorLogScan* header = static_cast<const SensorLogScan*>(payload(record));
+        size_t pointSize = record->type == SENSOR_LOG_LIDAR_NODES ? sizeof(LidarRawNode) : sizeof(SensorLogPoint);
+        if (record->size < sizeof(SensorLogScan) + header->pointCount * pointSize) return false;
+
+        scan.scan.clear();
+        scan.scan.reserve(header->pointCount);
+        scan.raw.clear();
+        scan.rejected = LidarRejections();
+        scan.timestampUs = record->timestampUs;
+        scan.sector = header->sector;
+        if (record->type == SENSOR_LOG_LIDAR_NODES) {
+            const LidarRawNode* nodes = reinterpret_cast<const LidarRawNode*>(header + 1);
+            appendGatedLidarNodes(scan, nodes, header->pointCount, filter, scale, subtractor, [&](size_t i) {return nodes[i].time;});
+            return true;
+        }
+
+        const SensorLogPoint* points = reinterpret_cast<const SensorLogPoint*>(header + 1);
+        for (uint32_t i = 0; i < header->pointCount; i++) {
+            float distance = (points[i].distance - subtractor) * scale;
+            if (distance <= 0) {
+                scan.rejected.noReturn++;
+                continue;
+            }
+            LidarPoint lp;
+            lp.setAngle(points[i].angle);
+            lp.distance = distance;
+            lp.time = points[i].time;
+            scan.scan.push_back(lp);
+        }
+        return true;
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+};
@@ -6,27 +6,51 @@
 
 #include "Vec2f.h"
 #include "Line.h"
+#include "LineMoments.h"
 #include "LidarPoint.h"
 #include "DisplayData.h"
 #include "LidarPoint.h"
 #include "Environment.h"
+#include "PoseHistory.h"
+#include "LidarScanIndex.h"
+#include "CorrespondenceTable.h"
+#include "ParticleFilter.h"
 #include "Pathfinder.h"
 #include "Run_Type.h"
 
 using namespace std;
 
+// Time constants (s) with which updateLidar blends the lidar estimates into the pose
+#define LIDAR_POSITION_TAU 0.8f
+#define LIDAR_HEADING_TAU 0.26f
+
 struct intersectionIndexPair {
     int index{-1};
     Vec2f point;
 };
 
+// Result of the joint pose estimate, headingError is added to the heading the scan was rotated with
+struct LidarPoseEstimate {
+    Vec2f position;
+    float headingError{0.0f};
+    float covariance[3][3]{}; // Of (x, y, heading), residual variance times the inverse of the Gauss-Newton matrix
+    int pointCount{0};
+    int iterations{0};
+};
+
 class Slam
 {
 public:
     void generateTestPoints(vector<LidarPoint>& lidarPoints, const Vec2f& pos, const vector<Line>& lms,
         const float& angleNoiseStdDeg = 2.0f, const float& distanceNoiseStd = 0.2f, const int& rayCount = 50);
 
-    int getUsablePoints(LidarScan scan, Vec2f estimatedPosition, const Environment& environment, LidarScan& useableScan);
+    int deskewScan(LidarScan& scan, const PoseHistory& poseHistory);
+
+    // Precomputes the landmark correspondence of isPointUseable for this environment and the current maxDeltaPosition
+    // The table is only used while maxDeltaPosition stays the value it was built for
+    int buildCorrespondenceTable(const Environment& environment, const std::string& cachePath);
+
+    int getUsablePoints(const LidarScan& scan, const Vec2f& estimatedPosition, const Environment& environment, LidarScan& useableScan);
 
     int getDistanceUseablePoints(const LidarScan& scan, LidarScan& useableScan);
 
@@ -34,8 +58,17 @@ public:
 
     optional<Vec2f> lidarEstimatePosition(const LidarScan& scan, const Environment& environment, const Vec2f& estimatedPosition);
 
+    // Point-to-line ICP for position and heading together, the landmark indices of getUsablePoints are kept for all iterations
+    optional<LidarPoseEstimate> lidarEstimatePose(const LidarScan& scan, const Environment& environment, const Vec2f& estimatedPosition);
+
     int getRunDirection(const Vec2f& position, const float& heading, const LidarScan& scan, enum RUN_TYPE runType, enum RUN_DIRECTION& runDirection, const bool& doUnparking);
 
+    int icpMaxIterations = 5;
+    float icpConvergence = 1e-5f; // Step in metres and radians below which the iteration stops
+    float icpPriorWeight = 1.0f;  // Weight of the estimated position, keeps a direction without walls where it was
+
+    ParticleFilter particleFilter; // Alternative to the estimates above, see SLAM_PARTICLE_FILTER
+
     float minPointDistance = 0.15f;
     float maxPointDistance = 3.65f;
     float maxDeltaPosition = 0.1f;
@@ -52,11 +85,14 @@ public:
     float angleForOpeningRunDirectionDetermination = 5.0f/180.0f*M_PI;
 
 private:
-    static float angleWeight(const Line& a, const Line& b);
-    std::optional<Vec2f> weightedAngleAverageSegmentIntersections(const std::vector<Line>& lines);
     bool isPointDistanceUseable(const LidarPoint& lp, const float& minDistance, const float& maxDistance);
-    bool isPointUseable(LidarPoint& lp, Vec2f estimatedPosition, float minDistance, float maxDistance, Environment environment);
-    Line linearRegression(const vector<Vec2f>& points);
-    optional<float> compareLines(const Line& a, const Line& b);
+    bool isPointUseable(LidarPoint& lp, Vec2f estimatedPosition, float minDistance, float maxDistance, const Environment& environment);
+    optional<float> compareLines(const Landmark& a, const Line& b);
     LidarPoint vec2fToLidarPoint(const Vec2f& point);
+
+    LidarScanIndex scanIndex; // Reused between calls so its buffer is only allocated once
+    // Scratch buffers of the frame functions, cleared on every call so a frame after the first ones does not allocate
+    vector<LineMoments> landmarkMoments;
+    LidarScan runDirectionScan;
+    CorrespondenceTable correspondenceTable;
 };
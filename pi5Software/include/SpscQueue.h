@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single producer / single consumer ring of N slots
+// Slots are filled and read in place so their contents (e.g. vector capacity) are reused
+template <typename T, size_t N>
+class SpscQueue
+{
+public:
+    /*-----Producer-----*/
+    // Slot to fill next; Returns nullptr if the queue is full
+    T* writeSlot()
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= N) return nullptr;
+        return &slots[h % N];
+    }
+
+    // Makes the slot returned by writeSlot() visible to the consumer
+    void commit() {head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);}
+
+    /*-----Consumer-----*/
+    // Oldest unread slot; Returns nullptr if the queue is empty
+    T* readSlot()
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return nullptr;
+        return &slots[t % N];
+    }
+
+    // Hands the slot returned by readSlot() back to the producer
+    void release() {tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);}
+
+private:
+    T slots[N];
+    alignas(64) std::atomic<size_t> head{0}; // Written by the producer
+    alignas(64) std::atomic<size_t> tail{0}; // Written by the consumer
+};
@@ -1,6 +1,12 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+
+// Monotonic time stamp in microseconds, used to relate samples of different sensors to each other
+inline uint64_t steadyTimestampUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 class TimerMillis {
 private:
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer triple buffer
+// The producer always owns a slot it can write into and the consumer always gets the newest complete value,
+// neither side ever blocks the other
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : middle(1), backIndex(2), frontIndex(0) {}
+
+    /*-----Producer-----*/
+    T& back() {return buffers[backIndex];}
+
+    // Hands the back slot to the consumer; Returns true if the previous value was never read and got overwritten
+    bool publish()
+    {
+        uint8_t old = middle.exchange(backIndex | FRESH_BIT, std::memory_order_acq_rel);
+        backIndex = old & INDEX_MASK;
+        return (old & FRESH_BIT) != 0;
+    }
+
+    // True while the last published value was not taken by the consumer yet
+    bool isPending() const {return (middle.load(std::memory_order_acquire) & FRESH_BIT) != 0;}
+
+    /*-----Consumer-----*/
+    // Moves the newest published value to the front slot; Returns false if nothing new was published since the last call
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH_BIT)) return false;
+        uint8_t old = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = old & INDEX_MASK;
+        return true;
+    }
+
+    T& front() {return buffers[frontIndex];}
+    const T& front() const {return buffers[frontIndex];}
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x03;
+    static constexpr uint8_t FRESH_BIT = 0x04;
+
+    T buffers[3];
+    alignas(64) std::atomic<uint8_t> middle; // Index of the shared slot and whether it holds an unread value
+    alignas(64) uint8_t backIndex;  // Only touched by the producer
+    alignas(64) uint8_t frontIndex; // Only touched by the consumer
+};
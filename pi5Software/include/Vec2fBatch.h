@@ -0,0 +1,306 @@
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Vec2f.h"
+#include "Line.h"
+
+// Whole-array versions of the Vec2f and Line operations of the hot loops, four elements per step
+// NEON on the Pi 5, SSE on x86 and the scalar loop elsewhere; The arrays stay Vec2f and Line, the kernels deinterleave them while loading
+// Results match the scalar code up to float rounding, Line::intersectionSegment stays the reference
+// VEC2F_BATCH_SCALAR forces the scalar loops, e.g. to test them on a machine with SIMD
+#if defined(VEC2F_BATCH_SCALAR)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VEC2F_BATCH_NEON
+#define VEC2F_BATCH_SIMD
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VEC2F_BATCH_SSE
+#define VEC2F_BATCH_SIMD
+#endif
+
+static_assert(sizeof(Vec2f) == 2 * sizeof(float), "Vec2f arrays are read as interleaved floats");
+static_assert(sizeof(Line) == 2 * sizeof(Vec2f), "Line arrays are read as interleaved floats");
+
+namespace Vec2fBatchDetail
+{
+    constexpr float PARALLEL_EPSILON = 1e-6f; // Same as Line::intersectionSegment
+
+    // Ray from (x1, y1) with delta (dx, dy) = start - end against a segment from (x3, y3) with delta (ex, ey) = start - end
+    // t is the hit as fraction of the ray; The scalar form of one lane of ClosestHit4
+    inline bool hitSegment(float x1, float y1, float dx, float dy, float x3, float y3, float ex, float ey, float& t)
+    {
+        float sx = x1 - x3, sy = y1 - y3;
+        float denom = dx * ey - dy * ex;
+        if (std::fabs(denom) < PARALLEL_EPSILON) return false;
+        t = (sx * ey - sy * ex) / denom;
+        float u = (sx * dy - sy * dx) / denom;
+        return inRange(t) && inRange(u);
+    }
+}
+
+#if defined(VEC2F_BATCH_SIMD)
+namespace Vec2fBatchDetail
+{
+#if defined(VEC2F_BATCH_NEON)
+    struct Mask4 {uint32x4_t m;};
+    struct Float4 {
+        float32x4_t v;
+        Float4() = default;
+        explicit Float4(float32x4_t pV) : v(pV) {}
+        explicit Float4(float f) : v(vdupq_n_f32(f)) {}
+    };
+    inline Float4 operator+(Float4 a, Float4 b) {return Float4(vaddq_f32(a.v, b.v));}
+    inline Float4 operator-(Float4 a, Float4 b) {return Float4(vsubq_f32(a.v, b.v));}
+    inline Float4 operator*(Float4 a, Float4 b) {return Float4(vmulq_f32(a.v, b.v));}
+    inline Float4 operator/(Float4 a, Float4 b) {return Float4(vdivq_f32(a.v, b.v));}
+    inline Float4 abs(Float4 a) {return Float4(vabsq_f32(a.v));}
+    inline Mask4 operator<(Float4 a, Float4 b) {return {vcltq_f32(a.v, b.v)};}
+    inline Mask4 operator>=(Float4 a, Float4 b) {return {vcgeq_f32(a.v, b.v)};}
+    inline Mask4 operator<=(Float4 a, Float4 b) {return {vcleq_f32(a.v, b.v)};}
+    inline Mask4 operator&(Mask4 a, Mask4 b) {return {vandq_u32(a.m, b.m)};}
+    inline Float4 select(Mask4 m, Float4 a, Float4 b) {return Float4(vbslq_f32(m.m, a.v, b.v));}
+    inline Float4 load(const float* p) {return Float4(vld1q_f32(p));}
+    inline void store(float* p, Float4 a) {vst1q_f32(p, a.v);}
+    inline void loadXY(const Vec2f* p, Float4& x, Float4& y) {float32x4x2_t xy = vld2q_f32(&p->x); x.v = xy.val[0]; y.v = xy.val[1];}
+    inline void storeXY(Vec2f* p, Float4 x, Float4 y) {vst2q_f32(&p->x, float32x4x2_t{{x.v, y.v}});}
+    inline void loadLines(const Line* l, Float4& sx, Float4& sy, Float4& ex, Float4& ey)
+    {
+        float32x4x4_t lines = vld4q_f32(&l->start.x);
+        sx.v = lines.val[0]; sy.v = lines.val[1]; ex.v = lines.val[2]; ey.v = lines.val[3];
+    }
+#elif defined(VEC2F_BATCH_SSE)
+    struct Mask4 {__m128 m;};
+    struct Float4 {
+        __m128 v;
+        Float4() = default;
+        explicit Float4(__m128 pV) : v(pV) {}
+        explicit Float4(float f) : v(_mm_set1_ps(f)) {}
+    };
+    inline Float4 operator+(Float4 a, Float4 b) {return Float4(_mm_add_ps(a.v, b.v));}
+    inline Float4 operator-(Float4 a, Float4 b) {return Float4(_mm_sub_ps(a.v, b.v));}
+    inline Float4 operator*(Float4 a, Float4 b) {return Float4(_mm_mul_ps(a.v, b.v));}
+    inline Float4 operator/(Float4 a, Float4 b) {return Float4(_mm_div_ps(a.v, b.v));}
+    inline Float4 abs(Float4 a) {return Float4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v));}
+    inline Mask4 operator<(Float4 a, Float4 b) {return {_mm_cmplt_ps(a.v, b.v)};}
+    inline Mask4 operator>=(Float4 a, Float4 b) {return {_mm_cmpge_ps(a.v, b.v)};}
+    inline Mask4 operator<=(Float4 a, Float4 b) {return {_mm_cmple_ps(a.v, b.v)};}
+    inline Mask4 operator&(Mask4 a, Mask4 b) {return {_mm_and_ps(a.m, b.m)};}
+    inline Float4 select(Mask4 m, Float4 a, Float4 b) {return Float4(_mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v)));}
+    inline Float4 load(const float* p) {return Float4(_mm_loadu_ps(p));}
+    inline void store(float* p, Float4 a) {_mm_storeu_ps(p, a.v);}
+    inline void loadXY(const Vec2f* p, Float4& x, Float4& y)
+    {
+        __m128 a = _mm_loadu_ps(&p[0].x);
+        __m128 b = _mm_loadu_ps(&p[2].x);
+        x.v = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        y.v = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    }
+    inline void storeXY(Vec2f* p, Float4 x, Float4 y)
+    {
+        _mm_storeu_ps(&p[0].x, _mm_unpacklo_ps(x.v, y.v));
+        _mm_storeu_ps(&p[2].x, _mm_unpackhi_ps(x.v, y.v));
+    }
+    inline void loadLines(const Line* l, Float4& sx, Float4& sy, Float4& ex, Float4& ey)
+    {
+        sx.v = _mm_loadu_ps(&l[0].start.x);
+        sy.v = _mm_loadu_ps(&l[1].start.x);
+        ex.v = _mm_loadu_ps(&l[2].start.x);
+        ey.v = _mm_loadu_ps(&l[3].start.x);
+        _MM_TRANSPOSE4_PS(sx.v, sy.v, ex.v, ey.v);
+    }
+#endif
+
+    // Closest hit of one ray over groups of four segments, the lanes keep their own best and are reduced at the end
+    // Shared by Vec2fBatch::closestIntersection (Line arrays) and SegmentBatch (structure of arrays)
+    class ClosestHit4
+    {
+    public:
+        explicit ClosestHit4(const Line& ray)
+            : x1(ray.start.x), y1(ray.start.y), dx(ray.start.x - ray.end.x), dy(ray.start.y - ray.end.y),
+              bestT(std::numeric_limits<float>::infinity()), bestIndex(-1.0f)
+        {
+            const float firstIndex[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+            index = load(firstIndex);
+        }
+
+        // The next four segments, given by their starts and start - end
+        void test(Float4 x3, Float4 y3, Float4 ex, Float4 ey)
+        {
+            const Float4 zero(0.0f), one(1.0f), epsilon(PARALLEL_EPSILON), none(std::numeric_limits<float>::infinity());
+            Float4 sx = x1 - x3;
+            Float4 sy = y1 - y3;
+            Float4 denom = dx * ey - dy * ex;
+            Float4 tt = (sx * ey - sy * ex) / denom;
+            Float4 uu = (sx * dy - sy * dx) / denom;
+            Mask4 hit = (abs(denom) >= epsilon) & (tt >= zero) & (tt <= one) & (uu >= zero) & (uu <= one);
+            Mask4 better = select(hit, tt, none) < bestT;
+            bestT = select(better, tt, bestT);
+            bestIndex = select(better, index, bestIndex);
+            index = index + Float4(4.0f);
+        }
+
+        // Lowest t of the lanes, on a tie the lower index like the scalar loop; Returns -1 if no lane hit
+        int reduce(float& t) const
+        {
+            int best = -1;
+            t = std::numeric_limits<float>::infinity();
+            float lanesT[4], lanesIndex[4];
+            store(lanesT, bestT);
+            store(lanesIndex, bestIndex);
+            for (int lane = 0; lane < 4; lane++) {
+                if (lanesIndex[lane] < 0.0f) continue;
+                if (lanesT[lane] < t || (lanesT[lane] == t && int(lanesIndex[lane]) < best)) {
+                    t = lanesT[lane];
+                    best = int(lanesIndex[lane]);
+                }
+            }
+            return best;
+        }
+
+    private:
+        const Float4 x1, y1, dx, dy;
+        Float4 bestT;
+        Float4 bestIndex;
+        Float4 index;
+    };
+}
+#endif
+
+class Vec2fBatch
+{
+public:
+    // out[i] = rotation * in[i] + translation, rotation is (cos, sin) of the angle, scaled if the points should be scaled too
+    // in and out may be the same array
+    static void transform(const Vec2f* in, Vec2f* out, size_t count, Vec2f rotation, Vec2f translation)
+    {
+        size_t i = 0;
+#if defined(VEC2F_BATCH_SIMD)
+        using namespace Vec2fBatchDetail;
+        const Float4 c(rotation.x), s(rotation.y), tx(translation.x), ty(translation.y);
+        for (; i + 4 <= count; i += 4) {
+            Float4 x, y;
+            loadXY(in + i, x, y);
+            storeXY(out + i, c * x - s * y + tx, s * x + c * y + ty);
+        }
+#endif
+        for (; i < count; i++) {
+            Vec2f p = in[i];
+            out[i] = Vec2f(rotation.x * p.x - rotation.y * p.y + translation.x, rotation.y * p.x + rotation.x * p.y + translation.y);
+        }
+    }
+
+    // out[i] = (points[i] - centre).lengthSquared()
+    static void distanceSquared(const Vec2f* points, size_t count, Vec2f centre, float* out)
+    {
+        size_t i = 0;
+#if defined(VEC2F_BATCH_SIMD)
+        using namespace Vec2fBatchDetail;
+        const Float4 cx(centre.x), cy(centre.y);
+        for (; i + 4 <= count; i += 4) {
+            Float4 x, y;
+            loadXY(points + i, x, y);
+            Float4 dx = x - cx;
+            Float4 dy = y - cy;
+            store(out + i, dx * dx + dy * dy);
+        }
+#endif
+        for (; i < count; i++) out[i] = (points[i] - centre).lengthSquared();
+    }
+
+    // Index of the segment the ray (a Line from its origin to its far end) hits first, -1 if it hits none
+    // t is the hit as fraction of the ray, the hit point is ray.start + ray.direction() * t like Line::intersectionSegment
+    static int closestIntersection(const Line& ray, const Line* segments, size_t count, float& t)
+    {
+        int best = -1;
+        t = std::numeric_limits<float>::infinity();
+        size_t i = 0;
+#if defined(VEC2F_BATCH_SIMD)
+        using namespace Vec2fBatchDetail;
+        ClosestHit4 hits(ray);
+        for (; i + 4 <= count; i += 4) {
+            Float4 x3, y3, x4, y4;
+            loadLines(segments + i, x3, y3, x4, y4);
+            hits.test(x3, y3, x3 - x4, y3 - y4);
+        }
+        best = hits.reduce(t);
+#endif
+        const float dx = ray.start.x - ray.end.x, dy = ray.start.y - ray.end.y;
+        for (; i < count; i++) {
+            const Line& segment = segments[i];
+            float segmentT;
+            if (Vec2fBatchDetail::hitSegment(ray.start.x, ray.start.y, dx, dy, segment.start.x, segment.start.y,
+                    segment.start.x - segment.end.x, segment.start.y - segment.end.y, segmentT) && segmentT < t) {
+                t = segmentT;
+                best = int(i);
+            }
+        }
+        return best;
+    }
+};
+// Segments stored as structure of arrays for casting many rays against the same walls, e.g. the landmarks of the Environment
+// Padded to a multiple of four with empty segments that are never hit, so the SIMD loop has no tail
+class SegmentBatch
+{
+public:
+    SegmentBatch() = default;
+    explicit SegmentBatch(const std::vector<Line>& lines) {assign(lines.data(), lines.size());}
+
+    void assign(const Line* lines, size_t count)
+    {
+        segmentCount = count;
+        size_t padded = (count + 3) & ~size_t(3);
+        startX.assign(padded, 0.0f);
+        startY.assign(padded, 0.0f);
+        deltaX.assign(padded, 0.0f);
+        deltaY.assign(padded, 0.0f);
+        for (size_t i = 0; i < count; i++) {
+            startX[i] = lines[i].start.x;
+            startY[i] = lines[i].start.y;
+            deltaX[i] = lines[i].start.x - lines[i].end.x;
+            deltaY[i] = lines[i].start.y - lines[i].end.y;
+        }
+    }
+
+    [[nodiscard]] size_t size() const {return segmentCount;}
+
+    // Same result as Vec2fBatch::closestIntersection over the original lines
+    int closestHit(const Line& ray, float& t) const
+    {
+#if defined(VEC2F_BATCH_SIMD)
+        using namespace Vec2fBatchDetail;
+        ClosestHit4 hits(ray);
+        for (size_t i = 0; i < startX.size(); i += 4) hits.test(load(&startX[i]), load(&startY[i]), load(&deltaX[i]), load(&deltaY[i]));
+        return hits.reduce(t);
+#else
+        int best = -1;
+        t = std::numeric_limits<float>::infinity();
+        const float dx = ray.start.x - ray.end.x, dy = ray.start.y - ray.end.y;
+        for (size_t i = 0; i < segmentCount; i++) {
+            float segmentT;
+            if (Vec2fBatchDetail::hitSegment(ray.start.x, ray.start.y, dx, dy, startX[i], startY[i], deltaX[i], deltaY[i], segmentT) && segmentT < t) {
+                t = segmentT;
+                best = int(i);
+            }
+        }
+        return best;
+#endif
+    }
+
+    // Casts every ray, indices[i] and t[i] as closestHit returns them
+    void closestHits(const Line* rays, size_t rayCount, int* indices, float* t) const
+    {
+        for (size_t i = 0; i < rayCount; i++) indices[i] = closestHit(rays[i], t[i]);
+    }
+
+private:
+    std::vector<float> startX;
+    std::vector<float> startY;
+    std::vector<float> deltaX; // start - end
+    std::vector<float> deltaY;
+    size_t segmentCount = 0;
+};
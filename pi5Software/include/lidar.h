@@ -1,22 +1,101 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+#include <cmath>
+
 #include "sl_lidar.h" 
 #include "sl_lidar_driver.h"
 #include "LidarPoint.h"
+#include "LidarNodes.h"
+#include "TripleBuffer.h"
+#include "SpscQueue.h"
+#include "Timer.h"
+
+#define LIDAR_SECTOR_QUEUE_SIZE 16
+#define LIDAR_FAULT_TIMEOUT_MS 1000			// Without a scan for this long the device is reset and restarted
+#define LIDAR_MIN_RECOVERY_BACKOFF_MS 200	// Wait before a restart attempt, doubled after every failed attempt
+#define LIDAR_MAX_RECOVERY_BACKOFF_MS 5000
+#define LIDAR_SPIN_UP_REVOLUTIONS 3			// Consecutive stable revolutions after which the device counts as spun up
+#define LIDAR_SPIN_UP_TOLERANCE 0.1f			// Allowed relative change of the revolution time and point count between stable revolutions
+#define LIDAR_SPIN_UP_TIMEOUT_MS 3000		// The scans are handed out after this long even if they never became stable
 
 sl::ILidarDriver* initLidar();
-int startLidar(sl::ILidarDriver* drv);
-int getLidarScan(sl::ILidarDriver* drv, LidarScan& scan, float scale = 1.0f, float subtractor = 0);
+int getLidarScanModes(sl::ILidarDriver* drv, std::vector<sl::LidarScanMode>& modes);
+// An empty scan mode name and a target sample rate of 0 select the typical mode of the device
+int startLidar(sl::ILidarDriver* drv, const std::string& scanMode = "", float targetSampleRate = 0.0f, sl::LidarScanMode* usedScanMode = nullptr);
+int getLidarScan(sl::ILidarDriver* drv, LidarScan& scan, float scale = 1.0f, float subtractor = 0, const LidarNodeFilter& filter = LidarNodeFilter());
+// Blocks until the next of sectorCount equally sized angular sectors of the revolution is complete
+int getLidarSector(sl::ILidarDriver* drv, LidarScan& sector, int sectorCount, float scale = 1.0f, float subtractor = 0, const LidarNodeFilter& filter = LidarNodeFilter());
+// Health reported by the device (SL_LIDAR_STATUS_OK, _WARNING or _ERROR), -1 if it does not answer; Only while not scanning
+int getLidarHealth(sl::ILidarDriver* drv);
+// Frames lost between a producer in another process and this one, only the simulation has such a transport
+struct LidarTransportStatistics
+{
+	uint64_t skippedFrames = 0;	// Published by the producer but replaced before they were read
+	uint64_t tornReads = 0;		// Reads that were overwritten while decoding and had to be repeated
+};
+LidarTransportStatistics getLidarTransportStatistics();
+// Stops the scan, resets the device and drops the connection so the next startLidar() starts from scratch
+int resetLidar(sl::ILidarDriver* drv);
 void stopLidar(sl::ILidarDriver*& drv);
 
+enum LIDAR_HEALTH {
+	LIDAR_HEALTH_STOPPED,
+	LIDAR_HEALTH_STARTING,		// Connecting and starting the scan
+	LIDAR_HEALTH_SPINNING_UP,	// Scanning, but the rotation is not stable yet so no scans are handed out
+	LIDAR_HEALTH_OK,
+	LIDAR_HEALTH_WARNING,		// Scans are still coming but the device reported a warning or no scan arrived for half the fault timeout
+	LIDAR_HEALTH_RECOVERING		// No scan for too long or the start failed, the device is reset and restarted
+};
+
+inline const char* lidarHealthName(LIDAR_HEALTH health)
+{
+	switch(health)
+	{
+		case LIDAR_HEALTH_STOPPED: return "Stopped";
+		case LIDAR_HEALTH_STARTING: return "Starting";
+		case LIDAR_HEALTH_SPINNING_UP: return "Spinning up";
+		case LIDAR_HEALTH_OK: return "OK";
+		case LIDAR_HEALTH_WARNING: return "Warning";
+		case LIDAR_HEALTH_RECOVERING: return "Recovering";
+	}
+	return "Unknown";
+}
+
+struct LidarStatistics
+{
+	uint64_t publishedScans = 0;	// Complete scans handed to the control loop
+	uint64_t overwrittenScans = 0;	// Scans replaced by a newer one before the control loop took them, and sectors discarded because the queue was full
+	uint64_t droppedScans = 0;		// Revolutions or sectors that could not be grabbed or contained no points
+	float revolutionsPerSecond = 0.0f;	// Measured, smoothed over the last few scans
+	float pointsPerSecond = 0.0f;		// Measured valid points handed to the control loop
+	LidarRejections rejected;			// Measurements dropped by the node filter, summed over all scans
+	LIDAR_HEALTH health = LIDAR_HEALTH_STOPPED;
+	uint64_t recoveries = 0;			// Times the device was reset and restarted
+	float latencyMs = 0.0f;				// Age of the last scan or sector when the control loop took it
+	LidarTransportStatistics transport;
+};
+
 class Lidar
 {
 public:
-	Lidar(float pScale = 1.0f, float pSubtractor = 0.0f) 
+	// A sector count above 0 enables streaming: the revolution is handed out in that many angular sectors as soon as each one completes
+	Lidar(float pScale = 1.0f, float pSubtractor = 0.0f, int pSectorCount = 0) 
 		: 
 		scale(pScale),
 		subtractor(pSubtractor),
-		driver(nullptr)
+		sectorCount(pSectorCount),
+		targetSampleRate(0.0f),
+		driver(nullptr),
+		runAcquisition(false)
 		{}
 		
 	~Lidar()
@@ -27,33 +106,357 @@ public:
 	bool init()
 	{
 		driver = initLidar();
-		if(!driver) return false;
+#if !defined(SIMULATION) && !defined(LIDAR_REPLAY)
+		if(!driver) return false; // The simulation and the replay have no driver object
+#endif
 		return true;
 	}
 	
+	// Hands the driver to the acquisition thread which starts the device and keeps it running; From here on only that thread talks to the driver
+	// Never blocks, the device is started in the background and restarted whenever it fails
 	bool start()
 	{
+#if !defined(SIMULATION) && !defined(LIDAR_REPLAY)
 		if(!driver) return false;
-		if(!startLidar(driver)) return false;
+#endif
+		if(acquisitionThread.joinable()) return true;
+		runAcquisition = true;
+		health = LIDAR_HEALTH_STARTING;
+		acquisitionThread = std::thread(&Lidar::acquisitionLoop, this);
 		return true;
 	}
 	
+	// Never blocks; Returns false if no new complete scan was published since the last call
 	bool getScan(LidarScan& scan)
 	{
-		if(!driver) return false;
-		if(!getLidarScan(driver, scan, scale, subtractor)) return false;
+		if(!mailbox.update()) return false;
+		scan = mailbox.front();
+		updateLatency(scan);
 		return true;
 	}
 	
+	// Streaming mode only; Never blocks, hands out every sector in order; Returns false if no sector is waiting
+	bool getSector(LidarScan& sector)
+	{
+		LidarScan* slot = sectorQueue.readSlot();
+		if(!slot) return false;
+		sector = *slot;
+		sectorQueue.release();
+		updateLatency(sector);
+		return true;
+	}
+
+	// Streaming mode only; Drops the queued sectors, e.g. the ones that piled up while only full revolutions were used
+	void discardSectors()
+	{
+		while(sectorQueue.readSlot()) sectorQueue.release();
+	}
+
+	bool isStreaming() const {return sectorCount > 0;}
+
+	// Lists the scan modes the device supports, connects to the device if needed
+	bool getScanModes(std::vector<sl::LidarScanMode>& modes)
+	{
+		if(acquisitionThread.joinable()) return false; // The driver belongs to the acquisition thread
+		if(!getLidarScanModes(driver, modes)) return false;
+		return true;
+	}
+
+	// A copy, the acquisition thread sets it again on every restart; Empty until the device was started once
+	sl::LidarScanMode getUsedScanMode() const
+	{
+		std::lock_guard<std::mutex> lock(usedScanModeMutex);
+		return usedScanMode;
+	}
+
+	LIDAR_HEALTH getHealth() const {return health.load(std::memory_order_relaxed);}
+
 	void stop()
 	{
-		if(!driver) return;
-		stopLidar(driver);
+		runAcquisition = false;
+		if(acquisitionThread.joinable()) acquisitionThread.join();
+		stopLidar(driver); // All backends ignore an already stopped device
+		health = LIDAR_HEALTH_STOPPED;
+	}
+
+	LidarStatistics getStatistics() const
+	{
+		LidarStatistics statistics;
+		statistics.publishedScans = publishedScans.load(std::memory_order_relaxed);
+		statistics.overwrittenScans = overwrittenScans.load(std::memory_order_relaxed);
+		statistics.droppedScans = droppedScans.load(std::memory_order_relaxed);
+		statistics.revolutionsPerSecond = revolutionsPerSecond.load(std::memory_order_relaxed);
+		statistics.pointsPerSecond = pointsPerSecond.load(std::memory_order_relaxed);
+		statistics.rejected.noReturn = rejectedNoReturn.load(std::memory_order_relaxed);
+		statistics.rejected.lowQuality = rejectedLowQuality.load(std::memory_order_relaxed);
+		statistics.rejected.rangeJump = rejectedRangeJump.load(std::memory_order_relaxed);
+		statistics.health = health.load(std::memory_order_relaxed);
+		statistics.recoveries = recoveries.load(std::memory_order_relaxed);
+		statistics.latencyMs = latencyMs.load(std::memory_order_relaxed);
+		statistics.transport = getLidarTransportStatistics();
+		return statistics;
 	}
 	
 	float scale;
 	float subtractor;
+	std::string scanMode;	// Name of the scan mode to use (e.g. Standard, Express, Boost, DenseBoost), empty selects by sample rate
+	float targetSampleRate;	// Samples per second, the closest mode is used; 0 and an empty name use the typical mode
+	const int sectorCount;
+	LidarNodeFilter nodeFilter; // Set before start()
 	
 private:
+	// State machine of the device: start it, grab scans until it stops delivering, then reset and restart it with a growing back off
+	void acquisitionLoop()
+	{
+		int backoffMs = LIDAR_MIN_RECOVERY_BACKOFF_MS;
+		while(runAcquisition.load(std::memory_order_relaxed))
+		{
+			switch(health.load(std::memory_order_relaxed))
+			{
+				case LIDAR_HEALTH_STARTING:
+				{
+					int status = getLidarHealth(driver);
+					sl::LidarScanMode startedMode{};
+					if(status != SL_LIDAR_STATUS_ERROR && startLidar(driver, scanMode, targetSampleRate, &startedMode))
+					{
+						{
+							std::lock_guard<std::mutex> lock(usedScanModeMutex);
+							usedScanMode = startedMode;
+						}
+						deviceWarning = status == SL_LIDAR_STATUS_WARNING;
+						health = LIDAR_HEALTH_SPINNING_UP;
+						lastDataTime = std::chrono::steady_clock::now();
+						spinUpStartTime = lastDataTime;
+						spunUp = false;
+						stableRevolutions = 0;
+						backoffMs = LIDAR_MIN_RECOVERY_BACKOFF_MS;
+						lastSector = -1;
+						hasLastScan = false;
+					}
+					else health = LIDAR_HEALTH_RECOVERING;
+					break;
+				}
+				case LIDAR_HEALTH_SPINNING_UP:
+				case LIDAR_HEALTH_OK:
+				case LIDAR_HEALTH_WARNING:
+				{
+					bool gotData = isStreaming() ? acquireSector() : acquireRevolution();
+					auto now = std::chrono::steady_clock::now();
+					if(gotData) lastDataTime = now;
+					if(now - lastDataTime > std::chrono::milliseconds(LIDAR_FAULT_TIMEOUT_MS))
+					{
+						fprintf(stderr, "[LIDAR] No scan for %d ms, restarting the device\n", LIDAR_FAULT_TIMEOUT_MS);
+						health = LIDAR_HEALTH_RECOVERING;
+					}
+					else if(!spunUp) health = LIDAR_HEALTH_SPINNING_UP;
+					// A single empty grab is normal between sectors, only a gap of half the fault timeout is a warning
+					else health = (deviceWarning || now - lastDataTime > std::chrono::milliseconds(LIDAR_FAULT_TIMEOUT_MS / 2)) ? LIDAR_HEALTH_WARNING : LIDAR_HEALTH_OK;
+					break;
+				}
+				case LIDAR_HEALTH_RECOVERING:
+				default:
+				{
+					resetLidar(driver);
+					recoveries.fetch_add(1, std::memory_order_relaxed);
+					sleepWhileRunning(backoffMs);
+					backoffMs = std::min(backoffMs * 2, LIDAR_MAX_RECOVERY_BACKOFF_MS);
+					health = LIDAR_HEALTH_STARTING;
+					break;
+				}
+			}
+		}
+	}
+
+	// Sleeps in small steps so stop() does not have to wait for a long back off
+	void sleepWhileRunning(int ms)
+	{
+		auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+		while(runAcquisition.load(std::memory_order_relaxed) && std::chrono::steady_clock::now() < end)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+
+	// Consumer side, the time from the end of the capture until the control loop took the data
+	void updateLatency(const LidarScan& scan)
+	{
+		if(scan.timestampUs == 0) return;
+		uint64_t now = steadyTimestampUs();
+		latencyMs.store(now > scan.timestampUs ? (now - scan.timestampUs) / 1000.0f : 0.0f, std::memory_order_relaxed);
+	}
+
+	// Returns false if no scan could be grabbed
+	bool acquireRevolution()
+	{
+		if(waitForConsumer && mailbox.isPending())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			return true; // Not a fault, the control loop is just slower than the replay
+		}
+		LidarScan& scan = mailbox.back();
+		scan.scan.clear(); // Keeps the capacity so steady state acquisition does not allocate
+		scan.raw.clear();
+		scan.rejected = LidarRejections();
+		if(!getLidarScan(driver, scan, scale, subtractor, nodeFilter) || scan.scan.empty())
+		{
+			droppedScans.fetch_add(1, std::memory_order_relaxed);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1)); // Avoid spinning on a failing device
+			return false;
+		}
+		countRejections(scan.rejected);
+		publishRevolution();
+		return true;
+	}
+
+	// Every sector is queued for the control loop and also collected into a full revolution for getScan(); Returns false if no sector could be grabbed
+	bool acquireSector()
+	{
+		LidarScan* slot = sectorQueue.writeSlot();
+		LidarScan& sector = slot ? *slot : spareSector;
+		sector.scan.clear();
+		sector.raw.clear();
+		sector.rejected = LidarRejections();
+		if(!getLidarSector(driver, sector, sectorCount, scale, subtractor, nodeFilter))
+		{
+			droppedScans.fetch_add(1, std::memory_order_relaxed);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			return false;
+		}
+
+		LidarScan& revolution = mailbox.back();
+		if(sector.sector <= lastSector && !revolution.scan.empty())
+		{
+			// Wrapped around, make the point times relative to the end of the last sector
+			float shift = (revolution.timestampUs - revolutionStartUs) / 1000000.0f;
+			for(LidarPoint& lp : revolution.scan) lp.time -= shift;
+			publishRevolution();
+		}
+		LidarScan& current = mailbox.back();
+		if(sector.sector <= lastSector || current.scan.empty())
+		{
+			current.scan.clear();
+			current.rejected = LidarRejections();
+			revolutionStartUs = sector.timestampUs;
+		}
+		float offset = (sector.timestampUs - revolutionStartUs) / 1000000.0f;
+		for(const LidarPoint& lp : sector.scan)
+		{
+			current.scan.push_back(lp); // Copies the cached direction
+			current.scan.back().time += offset;
+		}
+		current.timestampUs = sector.timestampUs;
+		current.sector = -1;
+		current.rejected += sector.rejected;
+		countRejections(sector.rejected);
+		lastSector = sector.sector;
+
+		if(!spunUp) return true; // The slot is reused, sectors of an unstable rotation are not handed out
+		if(slot) sectorQueue.commit();
+		else overwrittenScans.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	void countRejections(const LidarRejections& rejected)
+	{
+		rejectedNoReturn.fetch_add(rejected.noReturn, std::memory_order_relaxed);
+		rejectedLowQuality.fetch_add(rejected.lowQuality, std::memory_order_relaxed);
+		rejectedRangeJump.fetch_add(rejected.rangeJump, std::memory_order_relaxed);
+	}
+
+	// The revolution is stable if its time and point count barely changed compared to the previous one
+	// Returns true once enough stable revolutions followed each other, the scans are handed out from then on
+	bool checkSpinUp(size_t pointCount, float revolutionTime, std::chrono::steady_clock::time_point now)
+	{
+		if(spunUp) return true;
+		bool stable = hasLastScan && lastRevolutionTime > 0.0f && lastPointCount > 0
+			&& fabsf(revolutionTime - lastRevolutionTime) <= LIDAR_SPIN_UP_TOLERANCE * lastRevolutionTime
+			&& fabsf(float(pointCount) - float(lastPointCount)) <= LIDAR_SPIN_UP_TOLERANCE * lastPointCount;
+		stableRevolutions = stable ? stableRevolutions + 1 : 0;
+		lastRevolutionTime = hasLastScan ? revolutionTime : 0.0f;
+		lastPointCount = pointCount;
+
+		int elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - spinUpStartTime).count();
+		if(stableRevolutions >= LIDAR_SPIN_UP_REVOLUTIONS) printf("[LIDAR] Spun up after %d ms\n", elapsedMs);
+		else if(elapsedMs > LIDAR_SPIN_UP_TIMEOUT_MS) fprintf(stderr, "[LIDAR] Rotation not stable after %d ms, using the scans anyway\n", elapsedMs);
+		else return false;
+		spunUp = true;
+		return true;
+	}
+
+	void publishRevolution()
+	{
+		size_t pointCount = mailbox.back().scan.size();
+		if(pointCount == 0)
+		{
+			droppedScans.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		auto now = std::chrono::steady_clock::now();
+		float dt = std::chrono::duration<float>(now - lastScanTime).count();
+		if(!checkSpinUp(pointCount, dt, now))
+		{
+			lastScanTime = now;
+			hasLastScan = true;
+			return;
+		}
+		if(mailbox.publish()) overwrittenScans.fetch_add(1, std::memory_order_relaxed);
+		publishedScans.fetch_add(1, std::memory_order_relaxed);
+
+		// Throughput, exponentially smoothed
+		if(hasLastScan && dt > 0.0f)
+		{
+			float alpha = hasThroughput ? THROUGHPUT_SMOOTHING : 1.0f;
+			revolutionsPerSecond.store(revolutionsPerSecond.load(std::memory_order_relaxed) * (1.0f - alpha) + alpha / dt, std::memory_order_relaxed);
+			pointsPerSecond.store(pointsPerSecond.load(std::memory_order_relaxed) * (1.0f - alpha) + alpha * pointCount / dt, std::memory_order_relaxed);
+			hasThroughput = true;
+		}
+		lastScanTime = now;
+		hasLastScan = true;
+	}
+
+	static constexpr float THROUGHPUT_SMOOTHING = 0.2f;
+
+	// A replay as fast as possible would overwrite most revolutions in the mailbox, so the next one is only read once the last one was taken
+	// Streamed sectors are not held back, the queue already buffers them
+#ifdef LIDAR_REPLAY
+	static constexpr bool waitForConsumer = true;
+#else
+	static constexpr bool waitForConsumer = false;
+#endif
+
 	sl::ILidarDriver* driver;
+	sl::LidarScanMode usedScanMode{}; // Written by the acquisition thread, read by the control loop
+	mutable std::mutex usedScanModeMutex;
+
+	std::thread acquisitionThread;
+	std::atomic<bool> runAcquisition;
+	std::atomic<LIDAR_HEALTH> health{LIDAR_HEALTH_STOPPED};
+	TripleBuffer<LidarScan> mailbox;
+	SpscQueue<LidarScan, LIDAR_SECTOR_QUEUE_SIZE> sectorQueue;
+
+	std::atomic<uint64_t> publishedScans{0};
+	std::atomic<uint64_t> overwrittenScans{0};
+	std::atomic<uint64_t> droppedScans{0};
+	std::atomic<float> revolutionsPerSecond{0.0f};
+	std::atomic<float> pointsPerSecond{0.0f};
+	std::atomic<uint32_t> rejectedNoReturn{0};
+	std::atomic<uint32_t> rejectedLowQuality{0};
+	std::atomic<uint32_t> rejectedRangeJump{0};
+	std::atomic<uint64_t> recoveries{0};
+	std::atomic<float> latencyMs{0.0f}; // Written by the control loop
+
+	// Only touched by the acquisition thread
+	bool deviceWarning = false;
+	std::chrono::steady_clock::time_point lastDataTime;
+	bool spunUp = false;
+	int stableRevolutions = 0;
+	float lastRevolutionTime = 0.0f;
+	size_t lastPointCount = 0;
+	std::chrono::steady_clock::time_point spinUpStartTime;
+	bool hasThroughput = false;
+	bool hasLastScan = false;
+	std::chrono::steady_clock::time_point lastScanTime;
+	LidarScan spareSector; // Receives sectors while the queue is full
+	int lastSector = -1;
+	uint64_t revolutionStartUs = 0;
 };
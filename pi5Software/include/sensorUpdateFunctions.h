@@ -12,5 +12,5 @@
 
 void updateGyro(RobotSystem& robot);
 void updateEncoder(RobotSystem& robot);
-void updateLidar(RobotSystem& robot, std::chrono::milliseconds lidarDt);
+bool updateLidar(RobotSystem& robot, std::chrono::milliseconds lidarDt);
 void updateCamera(RobotSystem& robot);
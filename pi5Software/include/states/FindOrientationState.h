@@ -17,7 +17,7 @@ class FindOrientationState : public State{
     bool update(RobotSystem& robot) override
     {
         LidarScan lidarScan;
-        robot.lidar.getScan(lidarScan);
+        if(!robot.lidar.getScan(lidarScan)) return false;
         printf("Determining run direction\n");
         if(!robot.initSlam.getRunDirection(robot.position, robot.heading, lidarScan, robot.runType, robot.runDirection, robot.doUnparking)) return false;
 
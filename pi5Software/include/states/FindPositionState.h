@@ -1,11 +1,11 @@
 #pragma once
-#pragma once
 
 #include <chrono>
 
 #include "State.h"
 #include "RobotSystem.h"
 #include "LidarPoint.h"
+#include "FastMath.h"
 
 class FindPositionState : public State{
     void enter(RobotSystem& robot) override
@@ -19,6 +19,9 @@ class FindPositionState : public State{
     {
         if (iterations < 10)
         {
+            LidarScan lidarScan;
+            if(!robot.lidar.getScan(lidarScan)) return false;
+
             // Setup graphics for new frame
             dpd.clear();
             dpd.appendPoint(robot.position, RED, ESTIMATED_POSITION_POINT);
@@ -29,8 +32,6 @@ class FindPositionState : public State{
                 dpd.appendLine(robot.environment.landmarks[i].line, WHITE, LANDMARK_LINE);
             }
 
-            LidarScan lidarScan;
-            robot.lidar.getScan(lidarScan);
             lidarScan.rotate(robot.heading); // Rotate scan to align with robot's heading
             float beginningHeading = robot.heading;
 
@@ -44,7 +45,7 @@ class FindPositionState : public State{
                 float error = maybeNewEstimatedHeading.value();
                 lidarHeading = robot.heading + error;
                 robot.heading += error;
-                robot.heading = EncoderController::normaliseAngle(robot.heading);
+                robot.heading = FastMath::wrapAngle(robot.heading);
 
                 // The scan is corrected using the angle error from the lidar
                 // The useable points are reassigned to ensure greater accuracy
@@ -58,8 +59,11 @@ class FindPositionState : public State{
             auto maybeNewEstimatedPosition = robot.initSlam.lidarEstimatePosition(useableScan, robot.environment, robot.position);
 
             if(maybeNewEstimatedPosition.has_value()) {
-                iterations++; // Only increase iteration count if a valid position was found
                 robot.position = maybeNewEstimatedPosition.value();
+                wallFit = robot.distanceField.score(useableScan, robot.position, 0.0f, wallFitTruncation);
+                // Only a position the walls agree with counts, a poor one is repeated from where it got; After maxPoorFits every position counts so the run still starts
+                if (wallFit <= maxWallFitRms * maxWallFitRms) iterations++;
+                else if (++poorFits > maxPoorFits) {iterations++; printf("Wall fit %.1f mm rms, accepted after %d poor fits\n", sqrtf(wallFit) * 1000.0f, poorFits);}
 
                 Vec2f tmp = maybeNewEstimatedPosition.value();
                 dpd.appendPoint(tmp, YELLOW, NEW_ESTIMATED_POSITION_POINT);
@@ -75,7 +79,7 @@ class FindPositionState : public State{
 
     void exit(RobotSystem& robot) override
     {
-        if (!robot.doUnparking) {robot.pathfinder.setStartingPosition(robot.position); printf("Called!\n"); printf("Position: X: %.2f Y: %.2f\n", robot.position.x, robot.position.y);}
+        if (!robot.doUnparking) {robot.pathfinder.setStartingPosition(robot.position); printf("Called!\n"); printf("Position: X: %.2f Y: %.2f\n", robot.position.x, robot.position.y); printf("Wall fit: %.1f mm rms\n", sqrtf(wallFit) * 1000.0f);}
         else robot.pathfinder.setStartingPosition(Vec2f(2.0f, 0.5f));
     }
 
@@ -83,4 +87,9 @@ class FindPositionState : public State{
 
 private:
     int iterations = 0;
+    int poorFits = 0;
+    float wallFit = 0.0f; // Mean squared wall distance of the useable points at the last found position
+    const float wallFitTruncation = 0.2f; // Obstacle points count at most this far from a wall
+    const float maxWallFitRms = 0.1f;     // About 55 mm on recorded runs with the wide gate, the start pose before settling 140 mm
+    const int maxPoorFits = 20;
 };
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cmath>
+#include <ctime>
+#include <string>
+#include <iostream>
 
 #include "State.h"
 #include "RobotSystem.h"
@@ -31,10 +34,24 @@ public:
     {
         gyroTimer.reset();
         encoderTimer.reset();
+        if (robot.lidar.isStreaming()) {
+            lidarTimer.setDuration(LIDAR_UPDATE_TIME / robot.lidar.sectorCount); // One update per sector
+            robot.lidar.discardSectors();
+        }
         lidarTimer.reset();
         cameraTimer.reset();
         guidanceTimer.reset();
         uITimer.reset();
+
+        if (robot.recordSensorLog) {
+            std::string path = "sensorLog_" + std::to_string(time(nullptr)) + ".bin";
+            if (robot.sensorLog.open(path)) std::cout << "Recording sensor log: " << path << std::endl;
+        }
+    }
+
+    void exit(RobotSystem& robot) override
+    {
+        robot.sensorLog.close();
     }
 
     bool update(RobotSystem& robot) override
@@ -54,9 +71,9 @@ public:
         }
 
         /*----------Lidar-loop---------*/
+        // The timer is only reset once a new scan was processed, until then the mailbox is polled every loop
         if (lidarTimer.isExpired()) {
-            updateLidar(robot, lidarTimer.passedMs());
-            lidarTimer.reset();
+            if (updateLidar(robot, lidarTimer.passedMs())) lidarTimer.reset();
         }
 
         /*----------Camera-loop---------*/
@@ -98,6 +115,18 @@ public:
             robot.displayUI.currentWaypoint = robot.guidanceData.lookAtCurrentWaypoint().point;
             robot.displayUI.round = robot.pathfinder.getRound();
             robot.displayUI.startedLeft = robot.pathfinder.getStartedLeft();
+            LidarStatistics lidarStatistics = robot.lidar.getStatistics();
+            robot.displayUI.lidarRevolutionsPerSecond = lidarStatistics.revolutionsPerSecond;
+            robot.displayUI.lidarPointsPerSecond = lidarStatistics.pointsPerSecond;
+            robot.displayUI.lidarHealthy = lidarStatistics.health == LIDAR_HEALTH_OK;
+            robot.displayUI.lidarHealth = lidarHealthName(lidarStatistics.health);
+            robot.displayUI.lidarLatencyMs = lidarStatistics.latencyMs;
+            robot.displayUI.lidarRecoveries = int(lidarStatistics.recoveries);
+            robot.displayUI.lidarSkippedFrames = int(lidarStatistics.transport.skippedFrames);
+            robot.displayUI.lidarTornReads = int(lidarStatistics.transport.tornReads);
+            robot.displayUI.lidarRejectedNoReturn = int(lidarStatistics.rejected.noReturn);
+            robot.displayUI.lidarRejectedLowQuality = int(lidarStatistics.rejected.lowQuality);
+            robot.displayUI.lidarRejectedRangeJump = int(lidarStatistics.rejected.rangeJump);
             if(robot.runDirection == RUN_DIRECTION_CCW) robot.displayUI.runDirection = true;
             else robot.displayUI.runDirection = false;
             robot.displayUI.update();
@@ -10,6 +10,9 @@ class StartState : public State{
 	void enter(RobotSystem& robot) override 
 	{
 		robot.gpioController.setLed1High();
+
+		// Start the Lidar while waiting for the button so it is spun up when the run starts
+		robot.lidar.start();
 	}
 
     bool update(RobotSystem& robot) override
@@ -28,9 +31,6 @@ class StartState : public State{
 		robot.position = Vec2f(1.5f, 0.5f);
 		robot.heading = 0.0f;
 
-		// Start Lidar
-		robot.lidar.start();
-
 		// Init other sensors
 		robot.encoderController.reset();
 		robot.gyro.reset();
@@ -0,0 +1,175 @@
+#include "lidar.h"
+
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "SensorLog.h"
+#include "Timer.h"
+
+// Replays the lidar scans of a log written by SensorLogWriter
+// LIDAR_REPLAY_LOG selects the log, LIDAR_REPLAY_SPEED the playback speed: 1 is real time, 0 as fast as the control loop takes the scans
+// Logged nodes are gated with the node filter of the Lidar, logged points already passed the filter of the run
+#define DEFAULT_REPLAY_LOG_PATH "sensorLog.bin"
+#define DEFAULT_REPLAY_SPEED 1.0f
+
+static SensorLogReader reader;
+static bool isOpen = false;
+static float replaySpeed = DEFAULT_REPLAY_SPEED;
+static uint64_t firstScanUs = 0;   // Log time of the first scan
+static uint64_t replayStartUs = 0; // Steady time the first scan was handed out
+static bool reachedEnd = false;
+static uint64_t replayedScans = 0;
+
+// Init (replay → no real hardware)
+sl::ILidarDriver* initLidar() {
+    // No real driver needed for a replay
+    return nullptr;
+}
+
+static sl::LidarScanMode replayScanMode() {
+    sl::LidarScanMode mode{};
+    mode.id = 0;
+    mode.us_per_sample = 200.0f;
+    mode.max_distance = 12.0f;
+    snprintf(mode.scan_mode, sizeof(mode.scan_mode), "Replay");
+    return mode;
+}
+
+int getLidarScanModes(sl::ILidarDriver* drv, std::vector<sl::LidarScanMode>& modes) {
+    (void)drv; // unused
+    modes.assign(1, replayScanMode());
+    return 1;
+}
+
+// Start (map the log)
+int startLidar(sl::ILidarDriver* drv, const std::string& scanMode, float targetSampleRate, sl::LidarScanMode* usedScanMode) {
+    (void)drv; // unused
+    (void)scanMode; // The log decides
+    (void)targetSampleRate;
+    if (usedScanMode) *usedScanMode = replayScanMode();
+    if (isOpen) return 1;
+
+    const char* path = getenv("LIDAR_REPLAY_LOG");
+    if (!path) path = DEFAULT_REPLAY_LOG_PATH;
+    const char* speed = getenv("LIDAR_REPLAY_SPEED");
+    replaySpeed = speed ? strtof(speed, nullptr) : DEFAULT_REPLAY_SPEED;
+    if (replaySpeed < 0.0f) replaySpeed = 0.0f;
+
+    if (!reader.open(path)) {
+        std::cerr << "[LIDAR] Could not open the replay log: " << path << std::endl;
+        return 0;
+    }
+    isOpen = true;
+    reachedEnd = false;
+    firstScanUs = 0;
+    replayedScans = 0;
+
+    std::cout << "[LIDAR] Replaying " << path << " at ";
+    if (replaySpeed > 0.0f) std::cout << replaySpeed << "x speed." << std::endl;
+    else std::cout << "full speed." << std::endl;
+    return 1;
+}
+
+// Next lidar record of the log; Returns nullptr at the end of the log
+static const SensorLogRecord* nextScanRecord() {
+    const SensorLogRecord* record;
+    while ((record = reader.next())) {
+        if (isSensorLogScan(record->type)) return record;
+    }
+    if (!reachedEnd) std::cout << "[LIDAR] End of the replay log after " << replayedScans << " scans." << std::endl;
+    reachedEnd = true;
+    return nullptr;
+}
+
+// Hands out the recorded scans in order, in real time the scan is held back until its log time is reached
+// Recorded sectors are handed out as they are
+int getLidarScan(sl::ILidarDriver* drv, LidarScan& scan, float scale, float subtractor, const LidarNodeFilter& filter) {
+    (void)drv; // unused
+    if (!isOpen) return 0;
+
+    const SensorLogRecord* record = nextScanRecord();
+    if (!record) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100)); // Nothing will come anymore
+        return 0;
+    }
+    if (!SensorLogReader::readScan(record, scan, scale, subtractor, filter)) return 0; // Recorded nodes are gated again with this filter
+
+    if (firstScanUs == 0) {
+        firstScanUs = record->timestampUs;
+        replayStartUs = steadyTimestampUs();
+    }
+    if (replaySpeed > 0.0f) {
+        // Move the scan onto the steady clock of this run so it can be related to the live odometry
+        uint64_t dueUs = replayStartUs + uint64_t((record->timestampUs - firstScanUs) / replaySpeed);
+        uint64_t nowUs = steadyTimestampUs();
+        if (dueUs > nowUs) std::this_thread::sleep_for(std::chrono::microseconds(dueUs - nowUs));
+        scan.timestampUs = dueUs;
+    }
+    else scan.timestampUs = steadyTimestampUs();
+
+    replayedScans++;
+    return 1;
+}
+
+// The frame being split into sectors, dropped by resetLidar
+static LidarScan pendingFrame;
+static int nextSector = 0;
+
+// Recorded sectors are handed out as they are, recorded revolutions are split into sectors by angle
+int getLidarSector(sl::ILidarDriver* drv, LidarScan& sector, int sectorCount, float scale, float subtractor, const LidarNodeFilter& filter) {
+    if (nextSector == 0 || nextSector >= sectorCount) {
+        pendingFrame.scan.clear();
+        if (!getLidarScan(drv, pendingFrame, scale, subtractor, filter)) return 0;
+        if (pendingFrame.sector >= 0) {
+            sector.scan.swap(pendingFrame.scan);
+            sector.timestampUs = pendingFrame.timestampUs;
+            sector.sector = pendingFrame.sector % sectorCount;
+            sector.rejected = pendingFrame.rejected;
+            return 1;
+        }
+        nextSector = 0;
+    }
+
+    float sectorSpan = 2.0f * M_PI / sectorCount;
+    float begin = nextSector * sectorSpan;
+    float end = begin + sectorSpan;
+    for (const LidarPoint& lp : pendingFrame.scan) {
+        if (lp.angle >= begin && (lp.angle < end || nextSector == sectorCount - 1)) sector.scan.push_back(lp);
+    }
+    if (nextSector == 0) sector.rejected = pendingFrame.rejected; // Counted once per frame
+    sector.timestampUs = pendingFrame.timestampUs;
+    sector.sector = nextSector;
+    nextSector++;
+    return 1;
+}
+
+// The log is read in order, nothing can be lost on the way
+LidarTransportStatistics getLidarTransportStatistics() {
+    return LidarTransportStatistics();
+}
+
+int getLidarHealth(sl::ILidarDriver* drv) {
+    (void)drv; // unused
+    return SL_LIDAR_STATUS_OK;
+}
+
+// Reset (the replay continues with the next record, only the frame being split is dropped)
+int resetLidar(sl::ILidarDriver* drv) {
+    (void)drv; // unused
+    pendingFrame.scan.clear();
+    nextSector = 0;
+    return 1;
+}
+
+// Stop (unmap the log)
+void stopLidar(sl::ILidarDriver*& drv) {
+    (void)drv; // unused
+    if (!isOpen) return;
+    reader.close();
+    isOpen = false;
+    std::cout << "[LIDAR] Stopped. Replayed scans: " << replayedScans << std::endl;
+}
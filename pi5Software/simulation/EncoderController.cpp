@@ -20,10 +20,6 @@ int EncoderController::getEncodingData(float& deltaDistance, float& deltaHeading
     return 1;
 }
 
-float EncoderController::normaliseAngle(float angle) {
-    return fmodf(fmodf(angle, 2.0f * M_PI) + 2.0f * M_PI, 2.0f * M_PI); 
-}
-
 int EncoderController::dumbGrabData(float& angle) {
     return 1;
 }
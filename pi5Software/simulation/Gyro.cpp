@@ -1,4 +1,5 @@
 #include "Gyro.h"
+#include "FastMath.h"
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -112,8 +113,8 @@ int Gyro::getDeltaHeading(float& heading) {
 
     float diff = raw - lastYaw;
 
-    // shortest signed angular difference (-pi, pi]
-    diff = atan2f(sinf(diff), cosf(diff));
+    // shortest signed angular difference [-pi, pi)
+    diff = FastMath::wrapAngleSigned(diff);
 
     heading = diff;
     lastYaw = raw;
@@ -122,7 +123,3 @@ int Gyro::getDeltaHeading(float& heading) {
 
     return 1;
 }
-
-float Gyro::normaliseAngle(float angle) {
-    return fmodf(fmodf(angle, 2.0f * M_PI) + 2.0f * M_PI, 2.0f * M_PI);
-}
\ No newline at end of file
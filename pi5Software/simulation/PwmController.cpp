@@ -1,5 +1,6 @@
 // File: RobotControllersSim.cpp
 #include "PwmController.h"
+#include "FastMath.h"
 #include <cmath>
 #include <algorithm>
 #include <cstring>
@@ -122,7 +123,7 @@ void ServoController::setAngle(float angle) {
     currentAngle = angle;
 
     if(inverted) angle = 2.0f*M_PI - angle;
-    angle = normaliseAngle(angle);
+    angle = FastMath::wrapAngle(angle);
 
     if(angle <= M_PI && angle > maxAngle) angle = maxAngle;
     else if(angle > M_PI && angle < minAngle) angle = minAngle;
@@ -137,6 +138,3 @@ void ServoController::setMiddle() { setAngle(0.0f); }
 
 void ServoController::invert() { inverted = !inverted; }
 
-float ServoController::normaliseAngle(float angle) {
-    return std::fmod(std::fmod(angle, 2.0f*M_PI) + 2.0f*M_PI, 2.0f*M_PI);
-}
@@ -1,23 +1,92 @@
 #include "lidar.h"
 
 #include <iostream>
-#include <fstream>
-#include <vector>
+#include <atomic>
 #include <thread>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #define LIDAR_PATH "/dev/shm/lidar_shm.raw"
-#define NUMBER_OF_SAMPLES 500
-#define LIDAR_FRAME_SIZE (NUMBER_OF_SAMPLES * 2 * sizeof(float))
+#define MAX_NUMBER_OF_SAMPLES 2048
+#define FRAME_WAIT_TIMEOUT_MS 1000
+#define MAX_TORN_READ_RETRIES 8
+#define MAP_WAIT_TIMEOUT_MS 200
 
-// Buffer for raw data (angle, distance pairs)
-static std::vector<float> lidar_raw(NUMBER_OF_SAMPLES * 2);
+#define LIDAR_SHM_MAGIC 0x5244494Cu // The bytes "LIDR" at the start of the file
+#define LIDAR_SHM_VERSION 2         // 1 was the header without magic, version and sequence
 
-// Helper: check if shared memory file exists
-static bool file_exists(const char* path) {
-    struct stat buffer;
-    return (stat(path, &buffer) == 0);
+// Layout of the shared memory region written by the simulation (Godot), which is not part of this repository
+// Writer contract, the writer has to follow it exactly or the frames are rejected:
+// - The file is LIDAR_PATH, at least sizeof(LidarShmHeader) bytes, little endian, no padding between the fields below
+// - magic and version are written once before the first frame and never change while the file exists
+// - Per frame: sequence += 1 (odd, frame in progress), write sampleCount, timestampUs and the samples, then sequence += 1 (even, frame complete)
+//   The increments have to be release stores so the samples are visible before the even sequence (seqlock)
+// - samples holds sampleCount (angle, distance) float pairs: radians counter clockwise in [0, 2*PI), metres, 0 for no return
+// - timestampUs is the capture time on the steady clock of the robot software (CLOCK_MONOTONIC in microseconds)
+// A reader that sees the same even sequence before and after decoding got a consistent frame
+struct LidarShmHeader {
+    uint32_t magic;         // LIDAR_SHM_MAGIC
+    uint32_t version;       // LIDAR_SHM_VERSION
+    uint32_t sequence;
+    uint32_t sampleCount;   // Number of valid (angle, distance) pairs following the header
+    uint64_t timestampUs;   // Capture time of the frame
+};
+static_assert(sizeof(LidarShmHeader) == 24, "The writer relies on this layout");
+
+struct LidarShmFrame {
+    LidarShmHeader header;
+    float samples[MAX_NUMBER_OF_SAMPLES * 2]; // (angle, distance) pairs
+};
+
+static LidarShmFrame* frame = nullptr;
+static size_t mappedSize = 0;
+static uint32_t lastSequence = 0;
+
+// Statistics to detect a lagging consumer or a stalled simulation, read by the control loop through getLidarTransportStatistics
+static std::atomic<uint64_t> skippedFrames{0};
+static std::atomic<uint64_t> tornReads{0};
+
+static uint32_t loadSequence() {
+    return std::atomic_ref<uint32_t>(frame->header.sequence).load(std::memory_order_acquire);
+}
+
+static bool mapFrame() {
+    int fd = open(LIDAR_PATH, O_RDONLY);
+    if (fd == -1) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(LidarShmHeader)) {
+        close(fd);
+        return false;
+    }
+    mappedSize = std::min((size_t)st.st_size, sizeof(LidarShmFrame));
+
+    void* ptr = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // fd can be closed after mmap
+    if (ptr == MAP_FAILED) {
+        perror("[LIDAR] mmap");
+        return false;
+    }
+    // A writer that has not written the header yet is waited for, a header of another layout is an error
+    const LidarShmHeader* header = static_cast<const LidarShmHeader*>(ptr);
+    if (header->magic != LIDAR_SHM_MAGIC || header->version != LIDAR_SHM_VERSION) {
+        static bool reported = false;
+        if (header->magic != 0 && !reported) {
+            fprintf(stderr, "[LIDAR] %s has magic 0x%08x version %u, expected 0x%08x version %u; Update the simulation writer to the layout in simulation/lidar.cpp\n",
+                LIDAR_PATH, header->magic, header->version, LIDAR_SHM_MAGIC, LIDAR_SHM_VERSION);
+            reported = true;
+        }
+        munmap(ptr, mappedSize);
+        return false;
+    }
+    frame = static_cast<LidarShmFrame*>(ptr);
+    return true;
 }
 
 // Init (simulation → no real hardware)
@@ -26,62 +95,162 @@ sl::ILidarDriver* initLidar() {
     return nullptr;
 }
 
-// Start (wait for shared memory)
-int startLidar(sl::ILidarDriver* drv) {
+// The simulation publishes whole frames, it has a single fixed mode
+static sl::LidarScanMode simulationScanMode() {
+    sl::LidarScanMode mode{};
+    mode.id = 0;
+    mode.us_per_sample = 200.0f; // 500 samples per revolution at 10 Hz
+    mode.max_distance = 12.0f;
+    snprintf(mode.scan_mode, sizeof(mode.scan_mode), "Simulation");
+    return mode;
+}
+
+int getLidarScanModes(sl::ILidarDriver* drv, std::vector<sl::LidarScanMode>& modes) {
     (void)drv; // unused
+    modes.assign(1, simulationScanMode());
+    return 1;
+}
 
-    std::cout << "[LIDAR] Waiting for shared memory: " << LIDAR_PATH << std::endl;
+// Start (wait for shared memory and map it once); Gives up after a while so the Lidar class can retry and stop in between
+int startLidar(sl::ILidarDriver* drv, const std::string& scanMode, float targetSampleRate, sl::LidarScanMode* usedScanMode) {
+    (void)drv; // unused
+    (void)scanMode; // Only one mode in the simulation
+    (void)targetSampleRate;
+    if (usedScanMode) *usedScanMode = simulationScanMode();
+    if (frame) return 1;
+
+    static bool announced = false;
+    if (!announced) std::cout << "[LIDAR] Waiting for shared memory: " << LIDAR_PATH << std::endl;
+    announced = true;
 
-    while (!file_exists(LIDAR_PATH)) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(MAP_WAIT_TIMEOUT_MS);
+    while (!mapFrame()) {
+        if (std::chrono::steady_clock::now() > deadline) return 0;
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
+    lastSequence = loadSequence() & ~1u;
 
-    std::cout << "[LIDAR] Shared memory detected." << std::endl;
+    std::cout << "[LIDAR] Shared memory mapped." << std::endl;
     return 1;
 }
 
-// Read one scan
-int getLidarScan(sl::ILidarDriver* drv, LidarScan& scan, float scale, float offset) {
+// Read one scan; Waits until the simulation published a frame that was not read before
+int getLidarScan(sl::ILidarDriver* drv, LidarScan& scan, float scale, float offset, const LidarNodeFilter& filter) {
     (void)drv; // unused
+    (void)filter; // The simulation has no node quality
+    if (!frame) return 0;
 
-    std::ifstream file(LIDAR_PATH, std::ios::binary);
-    if (!file) {
-        std::cerr << "[LIDAR] Failed to open shared memory file." << std::endl;
-        return 0;
-    }
+    size_t maxSamples = (mappedSize - sizeof(LidarShmHeader)) / (2 * sizeof(float));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(FRAME_WAIT_TIMEOUT_MS);
+    int retries = MAX_TORN_READ_RETRIES;
 
-    // Read full frame
-    file.read(reinterpret_cast<char*>(lidar_raw.data()), LIDAR_FRAME_SIZE);
+    while (true) {
+        uint32_t sequence = loadSequence();
+        if ((sequence & 1u) || sequence == lastSequence) {
+            // Writer is busy or the frame is stale
+            if (std::chrono::steady_clock::now() > deadline) {
+                std::cerr << "[LIDAR] No new frame from the simulation." << std::endl;
+                return 0;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
 
-    if (file.gcount() != LIDAR_FRAME_SIZE) {
-        std::cerr << "[LIDAR] Incomplete frame read." << std::endl;
-        return 0;
-    }
+        // Decode straight from the mapping
+        scan.scan.clear();
+        scan.rejected = LidarRejections();
+        size_t sampleCount = std::min((size_t)frame->header.sampleCount, maxSamples);
+        uint64_t timestampUs = frame->header.timestampUs;
+        const float* samples = frame->samples;
+        for (size_t i = 0; i < sampleCount; i++) {
+            float angle = samples[i * 2];
+            float distance = samples[i * 2 + 1];
+
+            // Skip invalid measurements
+            if (distance <= 0.001f) {
+                scan.rejected.noReturn++;
+                continue;
+            }
 
-    // Clear previous scan data
-    scan.scan.clear();
-    scan.scan.reserve(NUMBER_OF_SAMPLES);
+            // Apply scaling + offset
+            distance = distance * scale - offset;
 
-    // Convert raw data into scan points
-    for (int i = 0; i < NUMBER_OF_SAMPLES; i++) {
-        float angle = lidar_raw[i * 2];
-        float distance = lidar_raw[i * 2 + 1];
+            scan.scan.emplace_back(angle, distance);
+        }
 
-        // Skip invalid measurements
-        if (distance <= 0.001f)
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (loadSequence() != sequence) {
+            // The writer started a new frame while decoding
+            tornReads++;
+            if (--retries <= 0) {
+                std::cerr << "[LIDAR] Could not read a consistent frame." << std::endl;
+                return 0;
+            }
             continue;
+        }
+
+        if (lastSequence != 0 && sequence - lastSequence > 2) skippedFrames += (sequence - lastSequence) / 2 - 1;
+        lastSequence = sequence;
+        scan.timestampUs = timestampUs;
+        return 1;
+    }
+}
 
-        // Apply scaling + offset
-        distance = distance * scale - offset;
+// The frame being split into sectors, dropped by resetLidar
+static LidarScan pendingFrame;
+static int nextSector = 0;
 
-        scan.scan.emplace_back(angle, distance);
+// Splits every simulation frame into sectors by angle and hands them out one at a time
+int getLidarSector(sl::ILidarDriver* drv, LidarScan& sector, int sectorCount, float scale, float offset, const LidarNodeFilter& filter) {
+    if (nextSector == 0 || nextSector >= sectorCount) {
+        pendingFrame.scan.clear();
+        if (!getLidarScan(drv, pendingFrame, scale, offset, filter)) return 0;
+        nextSector = 0;
     }
 
+    float sectorSpan = 2.0f * M_PI / sectorCount;
+    float begin = nextSector * sectorSpan;
+    float end = begin + sectorSpan;
+    for (const LidarPoint& lp : pendingFrame.scan) {
+        if (lp.angle >= begin && (lp.angle < end || nextSector == sectorCount - 1)) sector.scan.push_back(lp);
+    }
+    if (nextSector == 0) sector.rejected = pendingFrame.rejected; // Counted once per frame
+    sector.timestampUs = pendingFrame.timestampUs;
+    sector.sector = nextSector;
+    nextSector++;
+    return 1;
+}
+
+LidarTransportStatistics getLidarTransportStatistics() {
+    LidarTransportStatistics statistics;
+    statistics.skippedFrames = skippedFrames.load(std::memory_order_relaxed);
+    statistics.tornReads = tornReads.load(std::memory_order_relaxed);
+    return statistics;
+}
+
+int getLidarHealth(sl::ILidarDriver* drv) {
+    (void)drv; // unused
+    return SL_LIDAR_STATUS_OK;
+}
+
+static void unmapFrame() {
+    munmap(frame, mappedSize);
+    frame = nullptr;
+}
+
+// Reset (map the shared memory again, the simulation may have been restarted)
+int resetLidar(sl::ILidarDriver* drv) {
+    (void)drv; // unused
+    if (frame) unmapFrame();
+    pendingFrame.scan.clear();
+    nextSector = 0;
     return 1;
 }
 
-// Stop (nothing to clean up in simulation)
-void stopLidar(sl::ILidarDriver* drv) {
+// Stop (unmap the shared memory)
+void stopLidar(sl::ILidarDriver*& drv) {
     (void)drv; // unused
-    std::cout << "[LIDAR] Stopped." << std::endl;
-}
\ No newline at end of file
+    if (!frame) return;
+    unmapFrame();
+    std::cout << "[LIDAR] Stopped. Skipped frames: " << skippedFrames.load() << " Torn reads: " << tornReads.load() << std::endl;
+}
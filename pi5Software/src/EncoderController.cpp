@@ -1,4 +1,5 @@
 #include "EncoderController.h"
+#include "FastMath.h"
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -42,12 +43,8 @@ int EncoderController::getEncodingData(float& deltaDistance, float& deltaHeading
     //("Left: %.2f Right: %.2f\n", angleLeft, angleRight);
     
     // Handle wrap around and calculate revolutions
-    float deltaAngleLeft = angleLeft - lastAngleLeft;
-    if(deltaAngleLeft > M_PI) deltaAngleLeft -= 2.0f * M_PI;
-    else if(deltaAngleLeft < -M_PI) deltaAngleLeft += 2.0f * M_PI;
-    float deltaAngleRight = angleRight - lastAngleRight;
-    if(deltaAngleRight > M_PI) deltaAngleRight -= 2.0f * M_PI;
-    else if(deltaAngleRight < -M_PI) deltaAngleRight += 2.0f * M_PI;
+    float deltaAngleLeft = FastMath::angleDifference(angleLeft, lastAngleLeft);
+    float deltaAngleRight = FastMath::angleDifference(angleRight, lastAngleRight);
     
     float deltaDistanceLeft = WHEEL_CIRCUMFERENCE * deltaAngleLeft / (2.0f * M_PI);
     float deltaDistanceRight = WHEEL_CIRCUMFERENCE * deltaAngleRight / (2.0f * M_PI);
@@ -75,10 +72,6 @@ int EncoderController::getEncodingData(float& deltaDistance, float& deltaHeading
     return 1;
 }
 
-float EncoderController::normaliseAngle(float angle) {
-    return fmodf(fmodf(angle, 2.0f * M_PI) + 2.0f * M_PI, 2.0f * M_PI); 
-}
-
 void EncoderController::busyWaitMicroseconds(int us) {
     auto start = std::chrono::high_resolution_clock::now();
     while (true) {
@@ -101,7 +94,7 @@ int EncoderController::grabData(float& angleLeft, float& angleRight) {
     gpioController.disableSdaSwitch();
     busyWaitMicroseconds(us);
     if(!retryingGrabData(angleLeft2)) return 0;
-    angleLeft = atan2f(
+    angleLeft = FastMath::atan2(
         sinf(angleLeft1) + sinf(angleLeft2),
         cosf(angleLeft1) + cosf(angleLeft2)
     ); // Average the two readings to reduce bias; Wrap around exists so this complicated form is needed
@@ -144,6 +137,6 @@ int EncoderController::dumbGrabData(float& angle) {
     rawAngle &= 0x0FFF;
 
     angle = float(rawAngle) * 2.0f * M_PI / 4096.0f;
-    angle = normaliseAngle(angle);
+    angle = FastMath::wrapAngle(angle);
     return 1;
 }
@@ -7,6 +7,7 @@ extern "C" {
 }
 
 #include "Gyro.h"
+#include "FastMath.h"
 
 Gyro::Gyro() {
     fd = open("/dev/i2c-1", O_RDWR);
@@ -40,20 +41,13 @@ int Gyro::getDeltaHeading(float& heading) {
     float raw = 0.0;
     if (!readRawYaw(raw)) return 0;
 
-    heading = raw - lastYaw;
-
-    // Wrap delta into (-π, π] to handle crossing 0/2π boundary
-    if (heading >  M_PI) heading -= 2.0f * M_PI;
-    if (heading < -M_PI) heading += 2.0f * M_PI;
+    // Shortest signed difference to handle crossing the 0/2π boundary
+    heading = FastMath::angleDifference(raw, lastYaw);
 
     lastYaw = raw;  // advance for next call
     return 1;
 }
 
-float Gyro::normaliseAngle(float angle) {
-    return fmodf(fmodf(angle, 2.0f * M_PI) + 2.0f * M_PI, 2.0f * M_PI); 
-}
-
 int Gyro::readRawYaw(float& yaw) {
     if (!fdOpen) return 0;
 
@@ -75,7 +69,7 @@ int Gyro::readRawYaw(float& yaw) {
 
     int16_t raw = (int16_t)((buffer[1] << 8) | buffer[0]);
     yaw = raw / 32768.0 * M_PI;
-    yaw = normaliseAngle(yaw);
+    yaw = FastMath::wrapAngle(yaw);
     //printf("Angle: %.2f\n", yaw);
     return 1;
 }
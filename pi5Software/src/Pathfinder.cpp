@@ -34,25 +34,18 @@ void Pathfinder::setStartingPosition(Vec2f position)
     else startedLeft = false;
 }
 
-void Pathfinder::filterObstacles(std::vector<Obstacle> obstacles,  std::vector<Obstacle>& output){
+void Pathfinder::filterObstacles(const std::vector<Obstacle>& obstacles,  std::vector<Obstacle>& output){
     output.clear();
     for(int i = 0; i < 4; i++)
     {
-        std::vector<Obstacle> sideObstacles;
+        // The obstacle seen most often on this side, the first one wins a tie
+        const Obstacle* obstacle = nullptr;
         for (const Obstacle& obs : obstacles)
         {
-            if (inBox(obs.position, sides[i].lowerLeft, sides[i].upperRight))
-            {
-                sideObstacles.push_back(obs);
-            }
-        }
-        if (sideObstacles.size() <= 0) continue;
-        Obstacle obstacle = sideObstacles[0];
-        for (const Obstacle& obs : sideObstacles)
-        {
-            if (obs.count > obstacle.count) obstacle = obs;
+            if (!inBox(obs.position, sides[i].lowerLeft, sides[i].upperRight)) continue;
+            if (!obstacle || obs.count > obstacle->count) obstacle = &obs;
         }
-        output.push_back(obstacle);
+        if (obstacle) output.push_back(*obstacle);
     }
 }
 
@@ -1,4 +1,5 @@
 #include "PwmController.h"
+#include "FastMath.h"
 
 /*Superclass PwmController*/
 // Public
@@ -102,7 +103,7 @@ ServoController::~ServoController(){
 
 void ServoController::setAngle(float angle) {
     if(inverted) angle = 2.0f*M_PI - angle; // Invert angle if needed
-    angle = normaliseAngle(angle);
+    angle = FastMath::wrapAngle(angle);
     if(angle <= M_PI && angle > maxAngle) {
         angle = maxAngle;            
     }
@@ -133,8 +134,3 @@ void ServoController::invert(){
     inverted = !inverted;
 }
 
-// Protected
-float ServoController::normaliseAngle(float angle) {
-    float ret = fmod(fmod(angle, 2.0f*M_PI) + 2.0f*M_PI, 2.0f*M_PI);
-    return ret;
-}
@@ -28,17 +28,34 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <vector>
+#include <string>
+#include <algorithm>
 #include <cmath>
 
 #include "sl_lidar.h" 
 #include "sl_lidar_driver.h"
+#include "lidar.h"
 #include "LidarPoint.h"
+#include "FastMath.h"
+#include "Timer.h"
 
 #ifndef _countof
 #define _countof(_Array) (int)(sizeof(_Array) / sizeof(_Array[0]))
 #endif
 
+// Revolution time in seconds, used to interpolate the capture time of every node
+#define DEFAULT_REVOLUTION_TIME 0.1f
+#define MIN_REVOLUTION_TIME 0.03f
+#define MAX_REVOLUTION_TIME 0.3f
+
+// The node buffer holds one revolution of the active scan mode
+#define MIN_SCAN_FREQUENCY 5.0f
+#define MIN_NODE_BUFFER_SIZE size_t(700)
+
+#define SECTOR_TIMEOUT_MS 1000
+
 static inline void delay_ms(sl_word_size_t ms){
     while (ms>=1000){
         usleep(1000*1000);
@@ -50,26 +67,94 @@ static inline void delay_ms(sl_word_size_t ms){
 
 using namespace sl;
 
+// Everything that belongs to one start of the device; resetLidar clears it so a recovery does not continue the old stream
+struct LidarDeviceState {
+	std::vector<sl_lidar_response_measurement_node_hq_t> nodes; // Sized by startLidar for the selected mode
+	uint64_t lastScanEndUs = 0;
+
+	// Streaming
+	std::vector<sl_lidar_response_measurement_node_hq_t> intervalNodes;
+	std::vector<sl_lidar_response_measurement_node_hq_t> pendingNodes; // Received so far, belonging to the sector being collected and beyond
+	std::vector<uint64_t> pendingGrabUs; // Per pending node, when the batch holding it was grabbed
+	int currentSector = -1;
+	uint64_t lastSectorEndUs = 0;
+	float revolutionTime = DEFAULT_REVOLUTION_TIME;
+
+	void reset() {
+		nodes.clear();
+		lastScanEndUs = 0;
+		intervalNodes.clear(); // Sized again from nodes on the first sector
+		pendingNodes.clear();
+		pendingGrabUs.clear();
+		currentSector = -1;
+		lastSectorEndUs = 0;
+		revolutionTime = DEFAULT_REVOLUTION_TIME;
+	}
+};
+
+static LidarDeviceState device;
+
 sl::ILidarDriver* initLidar() {
     return *sl::createLidarDriver();
 }
 
-int startLidar(ILidarDriver * drv) {
-	const char *opt_channel = NULL;
+// Returns false if the serial port could not be bound, the Lidar class retries later
+static bool connectLidar(ILidarDriver * drv) {
+	if (drv->isConnected()) return true;
+
     const char *opt_channel_param_first = "/dev/ttyAMA0";
     sl_u32      opt_channel_param_second = 460800;
-    sl_result   op_result;
-	int         opt_channel_type = CHANNEL_TYPE_SERIALPORT;
 
     IChannel* _channel;
-
-    sl_lidar_response_device_health_t healthinfo;
-    sl_lidar_response_device_info_t devinfo;
 		_channel = (*createSerialPortChannel(opt_channel_param_first, opt_channel_param_second));
         
         if (SL_IS_FAIL((drv)->connect(_channel))) {
 			fprintf(stderr, "Error, cannot bind to the specified serial port %s.\n", opt_channel_param_first);		
+			return false;
         }
+		return true;
+}
+
+static float scanModeSampleRate(const LidarScanMode& mode) {
+	return 1000000.0f / mode.us_per_sample;
+}
+
+// Picks the mode by name (case insensitive) if one is given, else the mode closest to the target sample rate
+// Returns false if neither selects a mode so the typical mode of the device is used
+static bool selectScanMode(const std::vector<LidarScanMode>& modes, const std::string& name, float targetSampleRate, LidarScanMode& selected) {
+	if (!name.empty()) {
+		for (const LidarScanMode& mode : modes) {
+			if (strcasecmp(mode.scan_mode, name.c_str()) == 0) {selected = mode; return true;}
+		}
+		fprintf(stderr, "Lidar scan mode %s is not supported, ", name.c_str());
+		if (targetSampleRate <= 0) {fprintf(stderr, "using the typical mode\n"); return false;}
+		fprintf(stderr, "selecting by sample rate\n");
+	}
+	if (targetSampleRate <= 0 || modes.empty()) return false;
+
+	selected = modes[0];
+	for (const LidarScanMode& mode : modes) {
+		if (fabs(scanModeSampleRate(mode) - targetSampleRate) < fabs(scanModeSampleRate(selected) - targetSampleRate)) selected = mode;
+	}
+	return true;
+}
+
+int getLidarScanModes(ILidarDriver * drv, std::vector<LidarScanMode>& modes) {
+	modes.clear();
+	if (!connectLidar(drv)) return 0;
+	if (SL_IS_FAIL(drv->getAllSupportedScanModes(modes))) {
+		fprintf(stderr, "Error, cannot retrieve the supported scan modes.\n");
+		return 0;
+	}
+	return 1;
+}
+
+int startLidar(ILidarDriver * drv, const std::string& scanMode, float targetSampleRate, LidarScanMode* usedScanMode) {
+    sl_result   op_result;
+
+    sl_lidar_response_device_health_t healthinfo;
+    sl_lidar_response_device_info_t devinfo;
+		if (!connectLidar(drv)) return 0;
 
         // retrieving the device info
         ////////////////////////////////////////
@@ -135,56 +220,167 @@ int startLidar(ILidarDriver * drv) {
         }
 
 		drv->setMotorSpeed();
-		
-		if (SL_IS_FAIL(drv->startScan( 0,1 ))) // you can force slamtec lidar to perform scan operation regardless whether the motor is rotating
+
+		std::vector<LidarScanMode> modes;
+		LidarScanMode mode;
+		LidarScanMode usedMode;
+		if (getLidarScanModes(drv, modes)) {
+			for (const LidarScanMode& m : modes) printf("Lidar scan mode %d: %s %.0f samples/s\n", m.id, m.scan_mode, scanModeSampleRate(m));
+		}
+
+		if (selectScanMode(modes, scanMode, targetSampleRate, mode)) op_result = drv->startScanExpress(false, mode.id, 0, &usedMode);
+		else op_result = drv->startScan(0, 1, 0, &usedMode); // you can force slamtec lidar to perform scan operation regardless whether the motor is rotating
+		if (SL_IS_FAIL(op_result))
         {
             fprintf(stderr, "Error, cannot start the scan operation.\n");
             return 0;
         }
+		printf("Using lidar scan mode %s with %.0f samples/s\n", usedMode.scan_mode, scanModeSampleRate(usedMode));
+		if (usedScanMode) *usedScanMode = usedMode;
+
+		// Size the node buffer for a full revolution at the slowest supported rotation speed of this mode
+		device.nodes.resize(std::max(MIN_NODE_BUFFER_SIZE, size_t(scanModeSampleRate(usedMode) / MIN_SCAN_FREQUENCY) + 1));
 
-		delay_ms(3000);
-		
+		// No fixed spin up delay, the Lidar class holds the scans back until the rotation is stable
 		return 1;
 }
 
-int getLidarScan(ILidarDriver * drv, LidarScan& scan, float scale, float subtractor) {
+static inline float nodeAngleDegrees(const sl_lidar_response_measurement_node_hq_t& node) {
+	return (node.angle_z_q14 * 90.0f) / 16384.0f;
+}
+
+int getLidarScan(ILidarDriver * drv, LidarScan& scan, float scale, float subtractor, const LidarNodeFilter& filter) {
 	sl_result ans;
     
-	sl_lidar_response_measurement_node_hq_t nodes[700];
-	size_t   count = _countof(nodes);
+	std::vector<sl_lidar_response_measurement_node_hq_t>& nodes = device.nodes;
+	if (nodes.empty()) nodes.resize(MIN_NODE_BUFFER_SIZE);
+	size_t   count = nodes.size();
+	uint16_t startAngle = 0;
 
 	//printf("waiting for data...\n");
 
-	ans = drv->grabScanDataHq(nodes, count, 0);
-	if (SL_IS_OK(ans) || ans == SL_RESULT_OPERATION_TIMEOUT) {
-		drv->ascendScanData(nodes, count);
+	// Blocks until a full revolution is ready; This runs on the acquisition thread of the Lidar class so the control loop is never stalled
+	ans = drv->grabScanDataHq(nodes.data(), count);
+	uint64_t scanEndUs = steadyTimestampUs();
+	if (ans == SL_RESULT_OPERATION_TIMEOUT) {
+		return 0; // No full revolution in time, the Lidar class restarts the device if this persists
+	} else if (SL_IS_OK(ans)) {
+		// The nodes arrive in capture order starting at the sync point, remember where the revolution started before sorting by angle
+		if (count > 0) startAngle = nodes[0].angle_z_q14;
+		drv->ascendScanData(nodes.data(), count);
 	} else {
-		printf("error code: %x\n", ans);
-		fprintf(stderr, "Error, cannot grab scan data. Could also be timeout; missing handling implementation\n");
+		fprintf(stderr, "Error, cannot grab scan data, code: %x\n", ans);
 		return 0;
 	}
+
+	// Estimate the revolution time from the spacing of consecutive scans
+	uint64_t& lastScanEndUs = device.lastScanEndUs;
+	float revolutionTime = (scanEndUs - lastScanEndUs) / 1000000.0f;
+	if (lastScanEndUs == 0 || revolutionTime < MIN_REVOLUTION_TIME || revolutionTime > MAX_REVOLUTION_TIME) revolutionTime = DEFAULT_REVOLUTION_TIME;
+	lastScanEndUs = scanEndUs;
+	scan.timestampUs = scanEndUs;
 	
-	for (int pos = 0; pos < (int)count ; ++pos) {
-		/*
-		printf("%s theta: %03.2f Dist: %08.2f \n", 
-		(nodes[pos].flag & SL_LIDAR_RESP_HQ_FLAG_SYNCBIT) ?"S ":"  ", 
-		(nodes[pos].angle_z_q14 * 90.f) / 16384.f,
-		nodes[pos].dist_mm_q2/4.0f);
-		*/			
-		if(nodes[pos].dist_mm_q2 != 0.0f) {
-			float angle = (nodes[pos].angle_z_q14 * 90.0f) / 16384.0f;
-			angle = (angle / 180.0f * M_PI) + M_PI*1.5;	// Rotate
-			angle = fmodf(angle, 2*M_PI);
-			angle = 2*M_PI - angle; // Convert to CCW
-			angle = fmodf(angle, 2*M_PI);
-			float distance = ((nodes[pos].dist_mm_q2 / 4.0f / 1000.0f) - subtractor) * scale; // First subtract then scale		
-			if (distance > 0) scan.scan.emplace_back(angle, distance);
-		}			
-	}
+	// The head turns at a constant rate so the capture time follows from the angle swept since the start of the revolution
+	auto timeOf = [&](size_t pos) {
+		return (FastMath::binarySweep(startAngle, nodes[pos].angle_z_q14) - 1.0f) * revolutionTime;
+	};
+	keepRawLidarNodes(scan, nodes.data(), count, filter, timeOf);
+	appendGatedLidarNodes(scan, nodes.data(), count, filter, scale, subtractor, timeOf);
 	
 	return 1;
 }
 
+int getLidarSector(ILidarDriver * drv, LidarScan& sector, int sectorCount, float scale, float subtractor, const LidarNodeFilter& filter) {
+	std::vector<sl_lidar_response_measurement_node_hq_t>& intervalNodes = device.intervalNodes;
+	std::vector<sl_lidar_response_measurement_node_hq_t>& pendingNodes = device.pendingNodes;
+	std::vector<uint64_t>& pendingGrabUs = device.pendingGrabUs;
+	int& currentSector = device.currentSector;
+	uint64_t& lastSectorEndUs = device.lastSectorEndUs;
+	float& revolutionTime = device.revolutionTime;
+
+	if (intervalNodes.empty()) intervalNodes.resize(std::max(device.nodes.size(), MIN_NODE_BUFFER_SIZE));
+	float sectorSpan = 360.0f / sectorCount;
+	auto sectorOf = [&](const sl_lidar_response_measurement_node_hq_t& node) {
+		return std::min(int(nodeAngleDegrees(node) / sectorSpan), sectorCount - 1);
+	};
+
+	uint64_t deadlineUs = steadyTimestampUs() + SECTOR_TIMEOUT_MS * 1000;
+	size_t checked = 0;
+	while (true) {
+		// A sector is complete as soon as the first node of the next one arrived
+		for (; checked < pendingNodes.size(); checked++) {
+			int index = sectorOf(pendingNodes[checked]);
+			if (currentSector < 0 || checked == 0) currentSector = index;
+			if (index == currentSector) continue;
+
+			// The end of the sector is the capture of its last node: the grab time of its batch minus the sweep to the last node of that batch
+			// The time the next sector was noticed would add the batching delay of getScanDataWithIntervalHq
+			size_t last = checked - 1;
+			size_t batchLast = last;
+			while (batchLast + 1 < pendingNodes.size() && pendingGrabUs[batchLast + 1] == pendingGrabUs[last]) batchLast++;
+			float batchSweep = FastMath::binarySweep(pendingNodes[last].angle_z_q14, pendingNodes[batchLast].angle_z_q14);
+			uint64_t sectorEndUs = pendingGrabUs[last] - uint64_t(batchSweep * revolutionTime * 1000000.0f);
+			if (lastSectorEndUs != 0 && sectorEndUs > lastSectorEndUs) {
+				float estimate = (sectorEndUs - lastSectorEndUs) / 1000000.0f * sectorCount;
+				if (estimate >= MIN_REVOLUTION_TIME && estimate <= MAX_REVOLUTION_TIME) revolutionTime = estimate;
+			}
+			lastSectorEndUs = sectorEndUs;
+
+			sector.timestampUs = sectorEndUs;
+			sector.sector = currentSector;
+			const sl_lidar_response_measurement_node_hq_t& end = pendingNodes[checked - 1];
+			auto timeOf = [&](size_t i) {
+				return -FastMath::binarySweep(pendingNodes[i].angle_z_q14, end.angle_z_q14) * revolutionTime;
+			};
+			keepRawLidarNodes(sector, pendingNodes.data(), checked, filter, timeOf);
+			appendGatedLidarNodes(sector, pendingNodes.data(), checked, filter, scale, subtractor, timeOf);
+			pendingNodes.erase(pendingNodes.begin(), pendingNodes.begin() + checked);
+			pendingGrabUs.erase(pendingGrabUs.begin(), pendingGrabUs.begin() + checked);
+			currentSector = index;
+			return 1;
+		}
+
+		size_t count = intervalNodes.size();
+		sl_result ans = drv->getScanDataWithIntervalHq(intervalNodes.data(), count);
+		uint64_t grabUs = steadyTimestampUs();
+		if (SL_IS_FAIL(ans) && ans != SL_RESULT_OPERATION_TIMEOUT) {
+			fprintf(stderr, "Error, cannot grab sector data, code: %x\n", ans);
+			return 0;
+		}
+		if (count == 0) {
+			if (steadyTimestampUs() > deadlineUs) return 0;
+			delay_ms(1);
+			continue;
+		}
+		pendingNodes.insert(pendingNodes.end(), intervalNodes.begin(), intervalNodes.begin() + count);
+		pendingGrabUs.insert(pendingGrabUs.end(), count, grabUs);
+	}
+}
+
+// The device is read directly, nothing can be lost on the way
+LidarTransportStatistics getLidarTransportStatistics() {
+	return LidarTransportStatistics();
+}
+
+int getLidarHealth(ILidarDriver * drv) {
+	if (!connectLidar(drv)) return -1;
+	sl_lidar_response_device_health_t healthinfo;
+	if (SL_IS_FAIL(drv->getHealth(healthinfo))) return -1;
+	return healthinfo.status;
+}
+
+int resetLidar(ILidarDriver * drv) {
+	if (!drv) return 0;
+	if (drv->isConnected()) {
+		drv->stop();
+		drv->reset();
+		delay_ms(500); // The device reboots
+		drv->disconnect();
+	}
+	device.reset(); // The buffers are sized again by startLidar for the mode it selects
+	return 1;
+}
+
 void stopLidar(ILidarDriver*& drv) {  // pass by reference
     if(!drv) return;
     drv->stop();
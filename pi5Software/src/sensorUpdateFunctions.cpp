@@ -1,12 +1,11 @@
 #include "sensorUpdateFunctions.h"
 
 #include "../include/RobotSystem.h"
-
-#define LIDAR_POSITION_TAU 0.8f
-#define LIDAR_HEADING_TAU 0.26f
+#include "Timer.h"
+#include "FastMath.h"
 
 // Helper
-Vec2f boundPosition(Vec2f position, Environment environment) {
+Vec2f boundPosition(Vec2f position, const Environment& environment) {
     position.x = std::max(environment.outerBottomLeft.x, std::min(position.x, environment.outerTopRight.x));
     position.y = std::max(environment.outerBottomLeft.y, std::min(position.y, environment.outerTopRight.y));
     return position;
@@ -15,12 +14,18 @@ Vec2f boundPosition(Vec2f position, Environment environment) {
 void updateGyro(RobotSystem& robot)
 {
     float deltaHeading = 0.0f;
+    uint64_t timestampUs = steadyTimestampUs();
     if(robot.gyro.getDeltaHeading(deltaHeading)) {
         robot.heading += deltaHeading;
+        robot.odometryHeading += deltaHeading;
         robot.displayUI.gyroStatus = true;
+        robot.sensorLog.appendGyro(timestampUs, deltaHeading);
+        if(RobotSystem::useParticleFilter) robot.slam.particleFilter.predict(0.0f, deltaHeading);
     }
     else robot.displayUI.gyroStatus = false;
-    robot.heading = Gyro::normaliseAngle(robot.heading);
+    robot.heading = FastMath::wrapAngle(robot.heading);
+    robot.odometryHeading = FastMath::wrapAngle(robot.odometryHeading);
+    robot.poseHistory.push(timestampUs, robot.odometryPosition, robot.odometryHeading);
 }
 
 void updateEncoder(RobotSystem& robot)
@@ -28,25 +33,74 @@ void updateEncoder(RobotSystem& robot)
     // Update position and heading based on encoder data
     float deltaDistance = 0;
     float deltaHeading = 0;
+    uint64_t timestampUs = steadyTimestampUs();
     if(!robot.encoderController.getEncodingData(deltaDistance, deltaHeading)) {
         robot.displayUI.encoderStatus = false;
     }
-    else robot.displayUI.encoderStatus = true;
+    else {
+        robot.displayUI.encoderStatus = true;
+        robot.sensorLog.appendEncoder(timestampUs, deltaDistance, deltaHeading);
+#ifndef USE_ENCODER_FOR_HEADING
+        if(RobotSystem::useParticleFilter) robot.slam.particleFilter.predict(deltaDistance, 0.0f);
+#else
+        if(RobotSystem::useParticleFilter) robot.slam.particleFilter.predict(deltaDistance, deltaHeading);
+#endif
+    }
 #ifndef USE_ENCODER_FOR_HEADING
     robot.position += Vec2f(cosf(robot.heading), sinf(robot.heading)) * deltaDistance;
     robot.position = boundPosition(robot.position, robot.environment);
+    robot.odometryPosition += Vec2f(cosf(robot.odometryHeading), sinf(robot.odometryHeading)) * deltaDistance;
 #endif
 #ifdef USE_ENCODER_FOR_HEADING
     float midHeading = robot.heading + deltaHeading * 0.5f;
     robot.position += Vec2f(cosf(midHeading), sinf(midHeading)) * deltaDistance;
-    robot.position = boundPosition(robot.position, robot.landmarks);
+    robot.position = boundPosition(robot.position, robot.environment);
     robot.heading += deltaHeading;
-    robot.heading =  EncoderController::normaliseAngle(robot.heading);
+    robot.heading =  FastMath::wrapAngle(robot.heading);
+    float odometryMidHeading = robot.odometryHeading + deltaHeading * 0.5f;
+    robot.odometryPosition += Vec2f(cosf(odometryMidHeading), sinf(odometryMidHeading)) * deltaDistance;
+    robot.odometryHeading = FastMath::wrapAngle(robot.odometryHeading + deltaHeading);
 #endif
+    robot.poseHistory.push(timestampUs, robot.odometryPosition, robot.odometryHeading); // Not bounded, only differences are used
 }
 
-void updateLidar(RobotSystem& robot, std::chrono::milliseconds lidarDt)
+// Monte Carlo localisation instead of the blended lidar estimates, the pose is taken from the particles as it is
+// The filter starts around the pose of FindPositionState on the first scan
+static void localiseWithParticleFilter(RobotSystem& robot, const LidarScan& scan)
 {
+    ParticleFilter& filter = robot.slam.particleFilter;
+    if(!filter.isInitialised()) filter.initialise(robot.position, robot.heading, 0.05f, 0.05f, robot.environment);
+    LidarScan& rangeScan = robot.newPointsFrame; // Reused, the obstacle detection fills it again later
+    rangeScan.scan.clear();
+    robot.slam.getDistanceUseablePoints(scan, rangeScan);
+    std::optional<ParticlePose> pose = filter.update(rangeScan, robot.distanceField);
+    robot.displayUI.lidarHeadingStatus = pose.has_value();
+    robot.displayUI.lidarPositionStatus = pose.has_value();
+    if(!pose.has_value()) return;
+    robot.position = boundPosition(pose->position, robot.environment);
+    robot.heading = pose->heading;
+    dpd.appendPoint(pose->position, YELLOW, NEW_ESTIMATED_POSITION_POINT);
+}
+
+bool updateLidar(RobotSystem& robot, std::chrono::milliseconds lidarDt)
+{
+    // Only take the newest complete scan, never wait for the lidar
+    // When streaming, every new sector is combined with the latest other sectors into a full view
+    LidarScan& lidarScan = robot.lidarFrame;
+    size_t newPointCount = 0; // Points not seen by a previous call, they come first in the scan
+    if(robot.lidar.isStreaming()) {
+        LidarScan& sector = robot.lidarSectorFrame;
+        if(!robot.lidar.getSector(sector)) return false;
+        robot.sensorLog.appendScan(sector, robot.lidar.scale, robot.lidar.subtractor);
+        robot.lidarSectorWindow.add(sector);
+        newPointCount = robot.lidarSectorWindow.assemble(lidarScan);
+    }
+    else {
+        if(!robot.lidar.getScan(lidarScan)) return false;
+        robot.sensorLog.appendScan(lidarScan, robot.lidar.scale, robot.lidar.subtractor);
+        newPointCount = lidarScan.scan.size();
+    }
+
     // Setup graphics for new frame
     dpd.clear();
     dpd.appendPoint(robot.position, RED, ESTIMATED_POSITION_POINT);
@@ -57,68 +111,95 @@ void updateLidar(RobotSystem& robot, std::chrono::milliseconds lidarDt)
         dpd.appendLine(robot.environment.landmarks[i].line, WHITE, LANDMARK_LINE);
     }
 
-    LidarScan lidarScan;
-    robot.lidar.getScan(lidarScan);
+    robot.slam.deskewScan(lidarScan, robot.poseHistory); // Remove the motion during the revolution
+    if(RobotSystem::useParticleFilter) localiseWithParticleFilter(robot, lidarScan); // Before the rotation, every particle has its own heading
     lidarScan.rotate(robot.heading); // Rotate scan to align with robot's heading
     float beginningHeading = robot.heading;
 
-    LidarScan useableScan;
-    robot.slam.getUsablePoints(lidarScan, robot.position, robot.environment, useableScan);
-
-    std::optional<float> lidarHeading;
-    lidarHeading.reset();
-    std::optional<float> maybeNewEstimatedHeading = robot.slam.lidarEstimateHeading(useableScan, robot.environment, robot.position);
-     if(maybeNewEstimatedHeading.has_value()) {
-        float error = maybeNewEstimatedHeading.value();
-        lidarHeading = robot.heading + error;
-        float alpha = std::exp(-lidarDt.count() / 1000.0f / LIDAR_HEADING_TAU);
-        robot.heading += error * (1.0f - alpha);
-        robot.heading = EncoderController::normaliseAngle(robot.heading);
-
-        // The scan is corrected using the angle error from the lidar
-        // The useable points are reassigned to ensure greater accuracy
-        lidarScan.rotate(error);
-        useableScan.scan.clear();
+    LidarScan& useableScan = robot.useableFrame;
+    useableScan.scan.clear();
+
+    if(!RobotSystem::useParticleFilter) {
         robot.slam.getUsablePoints(lidarScan, robot.position, robot.environment, useableScan);
 
-        robot.displayUI.lidarHeadingStatus = true;
-    }
-    else {
-        robot.displayUI.lidarHeadingStatus = false;
-    }
-    for(const auto& lp : lidarScan.scan) {dpd.appendPoint(lp.point() + robot.position, GRAY, UNUSEABLE_LIDAR_POINT_POINT);}
-    for(const auto& lp : useableScan.scan) {dpd.appendPoint(lp.point() + robot.position, BLUE, USEABLE_LIDAR_POINT_POINT);}
+        std::optional<float> lidarHeading;
+        lidarHeading.reset();
+        std::optional<LidarPoseEstimate> pose;
+        std::optional<float> maybeNewEstimatedHeading;
+        if(RobotSystem::useJointPoseEstimate) {
+            pose = robot.slam.lidarEstimatePose(useableScan, robot.environment, robot.position);
+            if(pose.has_value()) maybeNewEstimatedHeading = pose->headingError;
+        }
+        else maybeNewEstimatedHeading = robot.slam.lidarEstimateHeading(useableScan, robot.environment, robot.position);
+        if(maybeNewEstimatedHeading.has_value()) {
+            float error = maybeNewEstimatedHeading.value();
+            lidarHeading = robot.heading + error;
+            float alpha = std::exp(-lidarDt.count() / 1000.0f / LIDAR_HEADING_TAU);
+            robot.heading += error * (1.0f - alpha);
+            robot.heading = FastMath::wrapAngle(robot.heading);
+
+            // The scan is corrected using the angle error from the lidar
+            lidarScan.rotate(error);
+            if(RobotSystem::useJointPoseEstimate) {
+                useableScan.rotate(error); // The position was solved together with the heading, the points keep their landmarks
+            }
+            else {
+                // The useable points are reassigned to ensure greater accuracy
+                useableScan.scan.clear();
+                robot.slam.getUsablePoints(lidarScan, robot.position, robot.environment, useableScan);
+            }
+
+            robot.displayUI.lidarHeadingStatus = true;
+        }
+        else {
+            robot.displayUI.lidarHeadingStatus = false;
+        }
+        for(const auto& lp : lidarScan.scan) {dpd.appendPoint(lp.point() + robot.position, GRAY, UNUSEABLE_LIDAR_POINT_POINT);}
+        for(const auto& lp : useableScan.scan) {dpd.appendPoint(lp.point() + robot.position, BLUE, USEABLE_LIDAR_POINT_POINT);}
 
-    auto maybeNewEstimatedPosition = robot.slam.lidarEstimatePosition(useableScan, robot.environment, robot.position);
+        std::optional<Vec2f> maybeNewEstimatedPosition;
+        if(RobotSystem::useJointPoseEstimate) {
+            if(pose.has_value()) maybeNewEstimatedPosition = pose->position;
+        }
+        else maybeNewEstimatedPosition = robot.slam.lidarEstimatePosition(useableScan, robot.environment, robot.position);
 
-    if(maybeNewEstimatedPosition.has_value()) {
-        Vec2f error = maybeNewEstimatedPosition.value() - robot.position;
-        float alpha = std::exp(-lidarDt.count() / 1000.0f / LIDAR_POSITION_TAU);
-        robot.position += error * (1.0f - alpha);
-        robot.position = boundPosition(robot.position, robot.environment);
+        if(maybeNewEstimatedPosition.has_value()) {
+            Vec2f error = maybeNewEstimatedPosition.value() - robot.position;
+            float alpha = std::exp(-lidarDt.count() / 1000.0f / LIDAR_POSITION_TAU);
+            robot.position += error * (1.0f - alpha);
+            robot.position = boundPosition(robot.position, robot.environment);
 
-        Vec2f tmp = maybeNewEstimatedPosition.value();
-        dpd.appendPoint(tmp, YELLOW, NEW_ESTIMATED_POSITION_POINT);
-        if(lidarHeading.has_value()) dpd.appendLine(Line(tmp, Vec2f(tmp.x + cos(lidarHeading.value()) * length, tmp.y + sin(lidarHeading.value()) * length)), YELLOW);
+            Vec2f tmp = maybeNewEstimatedPosition.value();
+            dpd.appendPoint(tmp, YELLOW, NEW_ESTIMATED_POSITION_POINT);
+            if(lidarHeading.has_value()) dpd.appendLine(Line(tmp, Vec2f(tmp.x + cos(lidarHeading.value()) * length, tmp.y + sin(lidarHeading.value()) * length)), YELLOW);
 
-        robot.displayUI.lidarPositionStatus = true;
+            robot.displayUI.lidarPositionStatus = true;
+        }
+        else {
+            robot.displayUI.lidarPositionStatus = false;
+        }
     }
     else {
-        robot.displayUI.lidarPositionStatus = false;
+        // The filter does not assign landmarks, so there are no useable points to show
+        for(const auto& lp : lidarScan.scan) {dpd.appendPoint(lp.point() + robot.position, GRAY, UNUSEABLE_LIDAR_POINT_POINT);}
     }
 
     /*---------Detect-obstacles----------*/
     if (robot.runType == RUN_TYPE_OBSTACLE_RUN)
     {
+        // Only new points are fed so every point is counted once
+        LidarScan& newScan = robot.newPointsFrame;
+        newScan.scan.assign(lidarScan.scan.begin(), lidarScan.scan.begin() + newPointCount);
         useableScan.scan.clear();
-        robot.slam.getDistanceUseablePoints(lidarScan, useableScan);
+        robot.slam.getDistanceUseablePoints(newScan, useableScan);
         robot.obstacleDetection.feedScan(useableScan, robot.position);
         for(const Obstacle& o : robot.obstacleDetection.possibleObstacles) {
             dpd.appendPoint(o.position, GRAY);
         }
-        std::vector<Obstacle> obstacles;
+        std::vector<Obstacle>& obstacles = robot.obstacleFrame;
+        obstacles.clear();
         robot.obstacleDetection.getObstacles(obstacles);
-        std::vector<Obstacle> filteredObstacles;
+        std::vector<Obstacle>& filteredObstacles = robot.filteredObstacleFrame;
         robot.pathfinder.filterObstacles(obstacles, filteredObstacles);
         for(const Obstacle& o : filteredObstacles) {
             if (o.getColor() == OBSTACLE_COLOUR_RED) dpd.appendPoint(o.position, RED);
@@ -132,6 +213,7 @@ void updateLidar(RobotSystem& robot, std::chrono::milliseconds lidarDt)
     dpd.updateVisibility(robot.visibility);
     dpd.appendPoint(robot.guidanceData.lookAtCurrentWaypoint().point, MAGENTA);
     robot.gp.update(dpd);
+    return true;
 }
 
 void updateCamera(RobotSystem& robot)
@@ -140,5 +222,7 @@ void updateCamera(RobotSystem& robot)
     std::vector<Obstacle> filteredObstacles;
     robot.obstacleDetection.getObstacles(obstacles);
     robot.pathfinder.filterObstacles(obstacles, filteredObstacles);
-    robot.obstacleDetection.feedImage(robot.camera.grabFrame(), filteredObstacles, robot.position, robot.heading);
+    cv::Mat frame = robot.camera.grabFrame();
+    robot.sensorLog.appendCamera(steadyTimestampUs());
+    robot.obstacleDetection.feedImage(frame, filteredObstacles, robot.position, robot.heading);
 }
@@ -2,6 +2,8 @@
 #include <algorithm>
 
 #include "Slam.h"
+#include "Vec2fBatch.h"
+#include "FastMath.h"
 #include "LidarPoint.h"
 #include "Environment.h"
 #include "Pathfinder.h" // For enum RUN_DIRECTION
@@ -9,55 +11,6 @@
 
 using namespace std;
 
-float Slam::angleWeight(const Line& a, const Line& b)
-{
-    Vec2f A = a.direction();
-    Vec2f B = b.direction();
-
-    float lenA = A.length();
-    float lenB = B.length();
-
-    if (lenA == 0.0f || lenB == 0.0f)
-        return 0.0f;
-
-    // 2D cross product magnitude (scalar)
-    float cross = A.x * B.y - A.y * B.x;
-
-    // normalized → |sin θ|
-    return std::fabs(cross) / (lenA * lenB);
-}
-
-std::optional<Vec2f> Slam::weightedAngleAverageSegmentIntersections(const std::vector<Line>& lines)
-{
-    double totalWeight = 0.0;
-    Vec2f weightedSum(0, 0);
-
-    const size_t n = lines.size();
-
-    for (size_t i = 0; i < n; ++i) {
-        for (size_t j = i + 1; j < n; ++j) {
-
-            auto p = Line::intersectionInfinite(lines[i], lines[j]);
-            if (!p.has_value())
-                continue;
-
-            float w = angleWeight(lines[i], lines[j]);
-            if (w <= 1e-8f)
-                continue;
-
-            weightedSum.x += p->x * w;
-            weightedSum.y += p->y * w;
-            totalWeight += w;
-        }
-    }
-
-    if (totalWeight == 0.0)
-        return std::nullopt;
-
-    float inv = 1.0f / static_cast<float>(totalWeight);
-    return Vec2f(weightedSum.x * inv, weightedSum.y * inv);
-}
-
 LidarPoint Slam::vec2fToLidarPoint(const Vec2f& point) {
     float distance = std::sqrt(point.x * point.x + point.y * point.y);
     float angle = std::atan2(point.y, point.x); // atan2 returns radians
@@ -86,31 +39,11 @@ void Slam::generateTestPoints(
         Line ray(pos, Vec2f(pos.x + cosf(noisyAngle) * maxRayDistance,
                             pos.y + sinf(noisyAngle) * maxRayDistance));
 
-        vector<intersectionIndexPair> intersections;
-
-        // Check all map segments
-        for (int j = 0; j < lms.size(); j++) {
-            optional<Vec2f> p = Line::intersectionSegment(ray, lms[j]);
-            if (p.has_value()) {
-                intersections.push_back(intersectionIndexPair(j, p.value()));
-            }
-        }
-
-        if (!intersections.empty()) {
-            // Find closest intersection:
-            float lowestDistance = (intersections[0].point - ray.start).lengthSquared();
-            intersectionIndexPair closest = intersections[0];
-
-            for (int k = 1; k < intersections.size(); k++) {
-                float d = (intersections[k].point - ray.start).lengthSquared();
-                if (d < lowestDistance) {
-                    lowestDistance = d;
-                    closest = intersections[k];
-                }
-            }
-
+        // Closest hit of all map segments
+        float t;
+        if (Vec2fBatch::closestIntersection(ray, lms.data(), lms.size(), t) != -1) {
             // Convert hit point to relative vector
-            Vec2f hitVec = closest.point - pos;
+            Vec2f hitVec = ray.direction() * t;
 
             // Convert to lidar polar for noise application
             LidarPoint lp = vec2fToLidarPoint(hitVec);
@@ -120,7 +53,7 @@ void Slam::generateTestPoints(
             if (lp.distance < 0.15f) lp.distance = 0.15f;
 
             // Add angle noise
-            lp.angle += angleNoiseRad(rng);
+            lp.setAngle(lp.angle + angleNoiseRad(rng));
 
             lidarPoints.push_back(lp);
         }
@@ -133,8 +66,18 @@ bool Slam::isPointDistanceUseable(const LidarPoint& lp, const float& minDistance
     return true;
 }
 
-bool Slam::isPointUseable(LidarPoint& lp, Vec2f estimatedPosition, float minDistance, float maxDistance, Environment environment) {
+bool Slam::isPointUseable(LidarPoint& lp, Vec2f estimatedPosition, float minDistance, float maxDistance, const Environment& environment) {
     if(!isPointDistanceUseable(lp, minDistance, maxDistance)) return false;
+
+    if (correspondenceTable.isReady() && correspondenceTable.maxDeltaPosition() == maxDeltaPosition) {
+        // The ray casts below were done when the table was built
+        const CorrespondenceEntry& entry = correspondenceTable.lookup(estimatedPosition, lp.angle);
+        if (entry.flags & CORRESPONDENCE_AMBIGUOUS) return false;
+        lp.lmIndex = entry.landmark;
+        if (!environment.landmarks[lp.lmIndex].isUseable) return false;
+        if (entry.flags & CORRESPONDENCE_NO_HIT) return false;
+        return fabs(entry.expectedRangeMm * 0.001f - lp.distance) <= maxDistanceDeviation;
+    }
     
     // Direction check
     Vec2f dir = lp.getDirection();
@@ -161,39 +104,15 @@ bool Slam::isPointUseable(LidarPoint& lp, Vec2f estimatedPosition, float minDist
     }
 
     // Check if the same landmark is hit at all possible position (approximated as 4), this is done to prevent points at edges being assigned to the wrong landmark
+    // All landmarks are tested at once for every corner ray by the batch kernel
+    Line rays[size];
+    for (int i = 0; i < size; i++) rays[i] = Line(maxPos[i], Vec2f(maxPos[i].x + dir.x * 1000, maxPos[i].y + dir.y * 1000));
     int correspondingIndex[size];
-    for (int i = 0; i < sizeof(maxPos) / sizeof(Vec2f); i++) {
-        Line line(maxPos[i], Vec2f(maxPos[i].x + dir.x * 1000, maxPos[i].y + dir.y * 1000));
-        //displayLines.push_back(line);
-        // Get all intersections
-        vector<intersectionIndexPair> intersections;
-        for (int j = 0; j < environment.landmarks.size(); j++) {
-            optional<Vec2f> p = Line::intersectionSegment(line, environment.landmarks[j].line);
-            if (p) {
-                intersections.push_back(intersectionIndexPair(j, p.value()));
-            }
-        }
-
-        if (!intersections.empty()) {
-            float lowestDistance = (intersections[0].point - line.start).lengthSquared();
-            intersectionIndexPair closestIntersection = intersections[0];
-            for (int i = 1; i < intersections.size(); i++) {
-                float distance = (intersections[i].point - line.start).lengthSquared();
-                if (distance < lowestDistance) {
-                    lowestDistance = distance;
-                    closestIntersection = intersections[i];
-                }
-            }
-            correspondingIndex[i] = closestIntersection.index;
-            //cout << "Point on Landmark: " << closestIntersection.index << endl;
-            //dpd.appendPoint(closestIntersection.point, RED, SLAM_DEBUG_POINT);
-            //dpd.appendLine(Line(maxPos[i], closestIntersection.point), RED, SLAM_DEBUG_LINE);
-        }
-        else {
-            correspondingIndex[i] = -1;
-            return false; // If a line has no intersection this point is not useable
-            //cout << "No intersection found" << endl;
-        }
+    float hitT[size];
+    environment.landmarkSegments.closestHits(rays, size, correspondingIndex, hitT);
+    for (int i = 0; i < size; i++) {
+        if (correspondingIndex[i] == -1) return false; // If a line has no intersection this point is not useable
+        //dpd.appendLine(Line(maxPos[i], rays[i].start + rays[i].direction() * hitT[i]), RED, SLAM_DEBUG_LINE);
     }
     for (int i = 1; i < size; i++) {
         if (correspondingIndex[i-1] != correspondingIndex[i]) {
@@ -209,36 +128,53 @@ bool Slam::isPointUseable(LidarPoint& lp, Vec2f estimatedPosition, float minDist
     
     // Check if the point is at a reasonable distance from the expected position of the landmark if it is closer it may be an obstacle
     Line line(estimatedPosition, Vec2f(estimatedPosition.x + dir.x * 1000, estimatedPosition.y + dir.y * 1000));
-    vector<intersectionIndexPair> intersections;
-    for (int j = 0; j < environment.landmarks.size(); j++) {
-        optional<Vec2f> p = Line::intersectionSegment(line, environment.landmarks[j].line);
-        if (p) {
-            intersections.push_back(intersectionIndexPair(j, p.value()));
-        }
-    }
+    float expectedT;
+    if (environment.landmarkSegments.closestHit(line, expectedT) == -1) return false;
 
-    if (!intersections.empty()) {
-        float lowestDistance = (intersections[0].point - line.start).lengthSquared();
-        intersectionIndexPair closestIntersection = intersections[0];
-        for (int i = 1; i < intersections.size(); i++) {
-            float distance = (intersections[i].point - line.start).lengthSquared();
-            if (distance < lowestDistance) {
-                lowestDistance = distance;
-            }
-        }
-    
-        lowestDistance = sqrtf(lowestDistance);
-        if(lowestDistance + maxDistanceDeviation < lp.distance) return false;
-        if(lowestDistance - maxDistanceDeviation > lp.distance) return false;
-    }
-    else return false;
+    float lowestDistance = (line.direction() * expectedT).length();
+    if(lowestDistance + maxDistanceDeviation < lp.distance) return false;
+    if(lowestDistance - maxDistanceDeviation > lp.distance) return false;
 
     return true;
 }
 
-int Slam::getUsablePoints(LidarScan scan, Vec2f estimatedPosition, const Environment& environment, LidarScan& useableScan) {
-    int useablePointCount = 0;
+int Slam::deskewScan(LidarScan& scan, const PoseHistory& poseHistory) {
+    // Moves every point from the pose at its capture time into the pose at the end of the scan
+    // Only the motion between the two poses is used, so the history may be in any frame; It must hold pure odometry without lidar corrections
+    if (scan.timestampUs == 0) return 0;
+    optional<StampedPose> endPose = poseHistory.at(scan.timestampUs);
+    if (!endPose.has_value()) return 0;
+
+    float cosEnd = cosf(-endPose->heading);
+    float sinEnd = sinf(-endPose->heading);
     for (LidarPoint& lp : scan.scan) {
+        if (lp.time == 0.0f) continue;
+        int64_t captureUs = int64_t(scan.timestampUs) + int64_t(lp.time * 1000000.0f);
+        if (captureUs <= 0) continue;
+        optional<StampedPose> capturePose = poseHistory.at(uint64_t(captureUs));
+        if (!capturePose.has_value()) continue;
+
+        // Point relative to the end position in world orientation, then rotated into the end heading
+        float worldAngle = lp.angle + capturePose->heading;
+        Vec2f direction;
+        FastMath::sinCos(worldAngle, direction.y, direction.x);
+        Vec2f rel = capturePose->position - endPose->position + direction * lp.distance;
+        Vec2f local(rel.x * cosEnd - rel.y * sinEnd, rel.x * sinEnd + rel.y * cosEnd);
+        lp.distance = local.length();
+        lp.angle = FastMath::wrapAngle(FastMath::atan2(local.y, local.x));
+        if (lp.distance > 0.0f) lp.direction = local / lp.distance; // Same as setAngle() without the cosf and sinf
+    }
+    return 1;
+}
+
+int Slam::buildCorrespondenceTable(const Environment& environment, const std::string& cachePath) {
+    return correspondenceTable.loadOrBuild(cachePath, environment, maxDeltaPosition) ? 1 : 0;
+}
+
+int Slam::getUsablePoints(const LidarScan& scan, const Vec2f& estimatedPosition, const Environment& environment, LidarScan& useableScan) {
+    int useablePointCount = 0;
+    for (const LidarPoint& point : scan.scan) {
+        LidarPoint lp = point; // isPointUseable assigns the landmark index, the input scan stays untouched
         if(isPointUseable(lp, estimatedPosition, minPointDistance, maxPointDistance, environment)) {
             useableScan.scan.push_back(lp);
             //printf("Usable Lidar Point - Angle: %f, Distance: %f, LmIndex: %d\n", lp.angle, lp.distance, lp.lmIndex);
@@ -259,66 +195,23 @@ int Slam::getDistanceUseablePoints(const LidarScan& scan, LidarScan& useableScan
     return useablePointCount;
 }
 
-Line Slam::linearRegression(const vector<Vec2f>& points) {
-    if (points.size() < 2)
-        return Line();
-
-    // --- 1. Compute centroid ---
-    Vec2f centroid(0.0f, 0.0f);
-    for (const auto& p : points) {
-        centroid.x += p.x;
-        centroid.y += p.y;
-    }
-    centroid.x /= points.size();
-    centroid.y /= points.size();
-
-    // --- 2. Compute covariance matrix ---
-    float Sxx = 0.0f, Syy = 0.0f, Sxy = 0.0f;
-
-    for (const auto& p : points) {
-        float dx = p.x - centroid.x;
-        float dy = p.y - centroid.y;
-
-        Sxx += dx * dx;
-        Syy += dy * dy;
-        Sxy += dx * dy;
-    }
-
-    // --- 3. Compute principal direction ---
-    // Solve eigenvector of covariance matrix
-    float theta = 0.5f * atan2f(2.0f * Sxy, Sxx - Syy);
-
-    Vec2f direction(cosf(theta), sinf(theta));
-
-    // --- 4. Create line through centroid ---
-    Vec2f p1 = centroid - direction;
-    Vec2f p2 = centroid + direction;
-
-    return Line(p1, p2);
-}
-
-optional<float> Slam::compareLines(const Line& a, const Line& b) {
-    Vec2f dirA = a.direction();
+optional<float> Slam::compareLines(const Landmark& a, const Line& b) {
     Vec2f dirB = b.direction();
     Vec2f dirBR = dirB * -1.0f;
 
-    //printf("DirA - X: %.2f Y: %.2f DirB - X: %.2f Y: %.2f\n", dirA.x, dirA.y, dirB.x, dirB.y);
-
-    float lenA = dirA.length();
     float lenB = dirB.length();
     
-    //printf("lenA: %.2f lenB: %.2f\n", lenA, lenB);
+    //printf("lenA: %.2f lenB: %.2f\n", a.length, lenB);
 
-    if (lenA < 1e-6f || lenB < 1e-6f) {
+    if (a.length < 1e-6f || lenB < 1e-6f) {
         //printf("Line rejected because of lenght\n");
         return std::nullopt;
     }
 
-    // Normalize directions
-    dirA = dirA * (1.0f / lenA);
+    // Normalize direction
     dirB = dirB * (1.0f / lenB);
 
-    float angleA = atan2f(dirA.y, dirA.x);
+    float angleA = a.angle; // Precomputed with the landmark
     if(angleA > M_PI/2.0f) angleA -= M_PI;
     if(angleA < -M_PI/2.0f) angleA += M_PI;
 
@@ -348,21 +241,20 @@ optional<float> Slam::compareLines(const Line& a, const Line& b) {
 optional<float> Slam::lidarEstimateHeading(const LidarScan& scan, const Environment& environment, Vec2f estimatedPosition) { // Position is only here for debugging and or visualisation
     float angleSum = 0.0f;
     int count = 0;
+    // One pass sorts the points into the moments of their landmark, the walls are fitted from the moments
+    landmarkMoments.assign(environment.landmarks.size(), LineMoments());
+    for(const LidarPoint& lp : scan.scan) {
+        if(lp.lmIndex < 0 || lp.lmIndex >= (int)landmarkMoments.size()) continue;
+        landmarkMoments[lp.lmIndex].add(lp.point());
+    }
     for(int i = 0; i < environment.landmarks.size(); i++) {
-        vector<Vec2f> points;
-        for(const LidarPoint& lp : scan.scan) {
-            if(lp.lmIndex != -1) {
-                if(lp.lmIndex == i) {
-                    points.push_back(lp.point());
-                }
-            }
-        }
-        //printf("Lm: %d Point Count: %d\n", i, points.size());
-        if(points.size() >= minPointsForLine) {
-            Line line = linearRegression(points);
+        const LineMoments& moments = landmarkMoments[i];
+        //printf("Lm: %d Point Count: %d\n", i, moments.n);
+        if(moments.n >= minPointsForLine) {
+            Line line = moments.fit();
             Line absLine = Line(line.start+estimatedPosition, line.end+estimatedPosition);
             dpd.appendLine(absLine, GRAY, SLAM_DEBUG_LINE);
-            optional<float> angle = compareLines(environment.landmarks[i].line, line);
+            optional<float> angle = compareLines(environment.landmarks[i], line);
             if(angle.has_value()) {
                 angleSum += angle.value();
                 count++;
@@ -376,41 +268,112 @@ optional<float> Slam::lidarEstimateHeading(const LidarScan& scan, const Environm
 }
 
 optional<Vec2f> Slam::lidarEstimatePosition(const LidarScan& scan, const Environment& environment, const Vec2f& estimatedPosition) {
-    vector<Line> parallels;
-    for (auto lp : scan.scan) {
+    // Every point puts the robot on a parallel of its landmark: normal.dot(p) == offset
+    // Least squares over all parallels through the 2x2 normal equations instead of intersecting every pair
+    // This is the average of the pairwise intersections weighted by sin^2 of their angle, the same as the sin weight for the right angled walls of the arena
+    double a00 = 0.0, a01 = 0.0, a11 = 0.0;
+    double b0 = 0.0, b1 = 0.0;
+    for (const LidarPoint& lp : scan.scan) {
         //printf("Lidar Point - Angle: %f, Distance: %f, LmIndex: %d\n", lp.angle, lp.distance, lp.lmIndex);
         if(lp.lmIndex == -1) continue; // Skip if no corresponding landmark (should not happen if all points are useable)
 
-        Vec2f normal = environment.landmarks[lp.lmIndex].line.normal();
-        Vec2f normalOpposite = normal * -1.0f;
-
-        float perpendicularDistance = lp.distance * fabs(lp.getDirection().dot(normal));
-        Line parallel1 = environment.landmarks[lp.lmIndex].line;
-        parallel1.start += normal * perpendicularDistance;
-        parallel1.end += normal * perpendicularDistance;
-
-        Line parallel2 = environment.landmarks[lp.lmIndex].line;
-        parallel2.start += normalOpposite * perpendicularDistance;
-        parallel2.end += normalOpposite * perpendicularDistance;
-
-        Vec2f point = environment.landmarks[lp.lmIndex].line.closestPointOnInfinite(estimatedPosition);
-        float fit1 = Vec2f::pointingTowards(point, normal, estimatedPosition);
-        float fit2 = Vec2f::pointingTowards(point, normalOpposite, estimatedPosition);
-        Line parallel;
-        if (fit1 > fit2) parallel = parallel1;
-        else parallel = parallel2;
-        dpd.appendLine(parallel, GREEN, SLAM_DEBUG_LINE);
-        //printf("Parallel line: start(%f, %f) end(%f, %f)\n", parallel.start.x, parallel.start.y, parallel.end.x, parallel.end.y);
-        parallels.push_back(parallel);
+        const Landmark& landmark = environment.landmarks[lp.lmIndex];
+        float perpendicularDistance = lp.distance * fabs(lp.getDirection().dot(landmark.normal));
+
+        // The parallel on the side of the wall the estimated position is on
+        float offset = landmark.signedDistance(estimatedPosition) <= 0.0f ? landmark.offset - perpendicularDistance : landmark.offset + perpendicularDistance;
+        Vec2f shift = landmark.normal * (offset - landmark.offset);
+        dpd.appendLine(Line(landmark.line.start + shift, landmark.line.end + shift), GREEN, SLAM_DEBUG_LINE);
+
+        double nx = landmark.normal.x;
+        double ny = landmark.normal.y;
+        a00 += nx * nx;
+        a01 += nx * ny;
+        a11 += ny * ny;
+        b0 += nx * offset;
+        b1 += ny * offset;
     }
-    optional<Vec2f> deltaPosition = weightedAngleAverageSegmentIntersections(parallels);
-    return deltaPosition;
+
+    // The determinant is the sum of sin^2 over all pairs, 0 if every point lies on parallel walls
+    double det = a00 * a11 - a01 * a01;
+    if (det <= 1e-8) return std::nullopt;
+    return Vec2f(float((a11 * b0 - a01 * b1) / det), float((a00 * b1 - a01 * b0) / det));
 }
 
 
+optional<LidarPoseEstimate> Slam::lidarEstimatePose(const LidarScan& scan, const Environment& environment, const Vec2f& estimatedPosition) {
+    // World point of a scan point: q = position + R(headingError) * p
+    // Residual: landmark.signedDistance(q), Jacobian (normal.x, normal.y, normal.dot(perpendicular of R * p))
+    LidarPoseEstimate estimate;
+    estimate.position = estimatedPosition;
+    double hessian[3][3];
+    int pointCount = 0;
+    double squaredError = 0.0;
+
+    for (int iteration = 0; iteration < icpMaxIterations; iteration++) {
+        double h[3][3] = {};
+        double g[3] = {};
+        Vec2f rotation;
+        FastMath::sinCos(estimate.headingError, rotation.y, rotation.x);
+        pointCount = 0;
+        squaredError = 0.0;
+        for (const LidarPoint& lp : scan.scan) {
+            if (lp.lmIndex == -1) continue;
+            const Landmark& landmark = environment.landmarks[lp.lmIndex];
+            Vec2f p = lp.point();
+            Vec2f rotated(p.x * rotation.x - p.y * rotation.y, p.x * rotation.y + p.y * rotation.x);
+            double e = landmark.signedDistance(estimate.position + rotated);
+            double j[3] = {landmark.normal.x, landmark.normal.y, landmark.normal.x * -rotated.y + landmark.normal.y * rotated.x};
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) h[r][c] += j[r] * j[c];
+                g[r] += j[r] * e;
+            }
+            squaredError += e * e;
+            pointCount++;
+        }
+        if (pointCount < 3) return nullopt;
+
+        // The prior pulls towards the estimated position, without it a view of parallel walls only is singular
+        h[0][0] += icpPriorWeight;
+        h[1][1] += icpPriorWeight;
+        g[0] += icpPriorWeight * (estimate.position.x - estimatedPosition.x);
+        g[1] += icpPriorWeight * (estimate.position.y - estimatedPosition.y);
+
+        // Inverse by the adjugate, the matrix is symmetric
+        double c00 = h[1][1] * h[2][2] - h[1][2] * h[2][1];
+        double c01 = h[1][2] * h[2][0] - h[1][0] * h[2][2];
+        double c02 = h[1][0] * h[2][1] - h[1][1] * h[2][0];
+        double det = h[0][0] * c00 + h[0][1] * c01 + h[0][2] * c02;
+        if (fabs(det) < 1e-12) return nullopt;
+        double inv = 1.0 / det;
+        hessian[0][0] = c00 * inv;
+        hessian[0][1] = hessian[1][0] = c01 * inv;
+        hessian[0][2] = hessian[2][0] = c02 * inv;
+        hessian[1][1] = (h[0][0] * h[2][2] - h[0][2] * h[2][0]) * inv;
+        hessian[1][2] = hessian[2][1] = (h[0][2] * h[1][0] - h[0][0] * h[1][2]) * inv;
+        hessian[2][2] = (h[0][0] * h[1][1] - h[0][1] * h[1][0]) * inv;
+
+        double step[3];
+        for (int r = 0; r < 3; r++) step[r] = -(hessian[r][0] * g[0] + hessian[r][1] * g[1] + hessian[r][2] * g[2]);
+        estimate.position += Vec2f(float(step[0]), float(step[1]));
+        estimate.headingError += float(step[2]);
+        estimate.iterations = iteration + 1;
+        if (fabs(step[0]) < icpConvergence && fabs(step[1]) < icpConvergence && fabs(step[2]) < icpConvergence) break;
+    }
+
+    // The covariance belongs to the matrix of the last iteration, the final step is below the convergence limit
+    double variance = pointCount > 3 ? squaredError / (pointCount - 3) : 0.0;
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) estimate.covariance[r][c] = float(variance * hessian[r][c]);
+    }
+    estimate.pointCount = pointCount;
+    return estimate;
+}
+
 int Slam::getRunDirection(const Vec2f& position, const float& heading, const LidarScan& inputScan, enum RUN_TYPE runType, enum RUN_DIRECTION& runDirection, const bool& doUnparking)
 {
-    LidarScan scan;
+    LidarScan& scan = runDirectionScan;
+    scan.scan.clear();
     getDistanceUseablePoints(inputScan, scan);
     
     if (scan.scan.size() <= 0) return 0;
@@ -422,19 +385,18 @@ int Slam::getRunDirection(const Vec2f& position, const float& heading, const Lid
         int wallCountLeft = 0;
         int wallCountRight = 0;
 
-        for (auto lp : scan.scan)
+        // Only the points in the windows towards the side walls are visited
+        scanIndex.build(scan);
+        scanIndex.forEachAround(M_PI/2.0f, angleForOpeningRunDirectionDetermination, [&](const LidarPoint& lp)
         {
-            if (lp.angle < M_PI/2.0f + angleForOpeningRunDirectionDetermination && lp.angle > M_PI/2.0f - angleForOpeningRunDirectionDetermination)
-            {
-                distanceWallLeft += lp.distance;
-                wallCountLeft++;
-            }
-            else if (lp.angle < 3.0f*M_PI/2.0f + angleForOpeningRunDirectionDetermination && lp.angle > 3.0f*M_PI/2.0f - angleForOpeningRunDirectionDetermination)
-            {
-                distanceWallRight += lp.distance;
-                wallCountRight++;
-            }
-        }
+            distanceWallLeft += lp.distance;
+            wallCountLeft++;
+        });
+        scanIndex.forEachAround(3.0f*M_PI/2.0f, angleForOpeningRunDirectionDetermination, [&](const LidarPoint& lp)
+        {
+            distanceWallRight += lp.distance;
+            wallCountRight++;
+        });
         
         if(wallCountLeft >= 1 && wallCountRight >= 1) // Prevent division by 0
         {
@@ -482,7 +444,7 @@ int Slam::getRunDirection(const Vec2f& position, const float& heading, const Lid
     {
         int countLeft = 0;
         int countRight = 0;
-        for (auto lp : scan.scan)
+        for (const LidarPoint& lp : scan.scan)
         {
             float perpDistance = fabs(sinf(lp.angle)) * lp.distance; 
             if(perpDistance > minimumPerpendicularDistanceForObstacleRunDirection) 
@@ -0,0 +1,62 @@
+#pragma once
+
+// Pose of every revolution of the imported corpus, tracked like the lidar part of updateLidar without odometry and blending
+// The first revolutions use a Slam with a wide gate to settle from the start pose, like FindPositionState
+// Shared by the corpus benchmark and the corpus tests so they work on the scans and poses the robot would see
+
+#include <vector>
+#include <cstddef>
+
+#include "Slam.h"
+#include "LidarCorpus.h"
+#include "Environment.h"
+#include "FastMath.h"
+
+#define DEFAULT_CORPUS_PATH "LidarTestData.bin" // Made by importLidarTestData in the build directory
+#define CORPUS_SETTLE_REVOLUTIONS 10
+
+// The prior revolution i is rotated and matched with
+struct CorpusPose {
+    Vec2f position;
+    float heading;
+};
+
+// Decodes revolution i, rotates it by the heading of the pose and fills useable with its usable points
+inline bool prepareCorpusScan(const LidarCorpus& corpus, size_t i, const CorpusPose& pose, Slam& slam, const Environment& environment, LidarScan& scan, LidarScan& useable)
+{
+    if (!corpus.getScan(i, scan)) return false;
+    scan.rotate(pose.heading);
+    useable.scan.clear();
+    slam.getUsablePoints(scan, pose.position, environment, useable);
+    return true;
+}
+
+// Returns the number of revolutions with both a heading and a position estimate
+inline size_t trackCorpus(const LidarCorpus& corpus, const Environment& environment, std::vector<CorpusPose>& poses)
+{
+    Slam settleSlam;
+    settleSlam.maxDistanceDeviation = 0.7f;
+    settleSlam.maxDeltaPosition = 0.0f;
+    Slam slam;
+    CorpusPose pose{Vec2f(1.5f, 0.5f), 0.0f};
+    LidarScan scan;
+    LidarScan useable;
+    size_t tracked = 0;
+    poses.clear();
+    for (size_t i = 0; i < corpus.size(); i++) {
+        poses.push_back(pose);
+        Slam& s = i < CORPUS_SETTLE_REVOLUTIONS ? settleSlam : slam;
+        if (!prepareCorpusScan(corpus, i, pose, s, environment, scan, useable)) continue;
+        std::optional<float> headingError = s.lidarEstimateHeading(useable, environment, pose.position);
+        if (!headingError.has_value()) continue;
+        pose.heading = FastMath::wrapAngle(pose.heading + headingError.value());
+        scan.rotate(headingError.value());
+        useable.scan.clear();
+        s.getUsablePoints(scan, pose.position, environment, useable);
+        std::optional<Vec2f> position = s.lidarEstimatePosition(useable, environment, pose.position);
+        if (!position.has_value()) continue;
+        pose.position = position.value();
+        tracked++;
+    }
+    return tracked;
+}
@@ -0,0 +1,145 @@
+// Checks that the lidar part of a control loop frame does not allocate once the buffers have grown
+// operator new is replaced by a counter; The frames are run once to warm up, the second time every allocation is an error
+// A frame is the lidar part of updateLidar: de-skewing, usable points, heading, position and joint pose estimate,
+// obstacle detection (only with OpenCV, the obstacles are fixed otherwise) and filterObstacles, plus getRunDirection
+// and the particle filter of SLAM_PARTICLE_FILTER; Its workers are started before the warm up and only woken in a frame
+// Registered with ctest, run it after touching any of them
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+#include "Slam.h"
+#include "Environment.h"
+#include "DisplayData.h"
+#include "PoseHistory.h"
+#include "Pathfinder.h"
+#include "DistanceField.h"
+#ifdef HAVE_OPENCV
+#include "ObstacleDetection.h"
+#endif
+
+#define TEST_FRAMES 30
+#define TEST_RAYS 500
+#define MIN_USEABLE_POINTS 200 // Per frame, about 310 with the seed below; Fewer means getUsablePoints rejects walls it should keep
+#define REVOLUTION_TIME_US 100000
+
+DisplayData dpd; // Defined in main.cpp for the robot
+
+static bool countAllocations = false;
+static long allocations = 0;
+
+void* operator new(size_t size) {
+    if (countAllocations) allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) {return operator new(size);}
+void operator delete(void* p) noexcept {free(p);}
+void operator delete[](void* p) noexcept {free(p);}
+void operator delete(void* p, size_t) noexcept {free(p);}
+void operator delete[](void* p, size_t) noexcept {free(p);}
+
+int main() {
+    Environment environment(0.16f, RUN_TYPE_OBSTACLE_RUN, false);
+    Slam slam;
+    std::vector<Line> landmarks;
+    for (const Landmark& landmark : environment.landmarks) landmarks.push_back(landmark.line);
+
+    Pathfinder pathfinder(0.16f, RUN_TYPE_OBSTACLE_RUN, false);
+#ifdef HAVE_OPENCV
+    ObstacleDetection obstacleDetection;
+#endif
+
+    // Synthetic scans from random positions around the inner walls, the points spread over one revolution
+    struct Frame {
+        LidarScan scan;
+        Vec2f position; // Where the scan was generated, the estimate of the frame
+    };
+    std::vector<Frame> frames;
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> coordinate(0.3f, 2.7f);
+    while (frames.size() < TEST_FRAMES) {
+        Vec2f position(coordinate(random), coordinate(random));
+        if (position.x > 0.9f && position.x < 2.1f && position.y > 0.9f && position.y < 2.1f) continue;
+        Frame frame;
+        frame.position = position;
+        slam.generateTestPoints(frame.scan.scan, position, landmarks, 0.5f, 0.02f, TEST_RAYS);
+        size_t count = frame.scan.scan.size();
+        for (size_t i = 0; i < count; i++) frame.scan.scan[i].time = -float(count - 1 - i) / count * (REVOLUTION_TIME_US / 1000000.0f);
+        frame.scan.timestampUs = 2 * REVOLUTION_TIME_US;
+        frames.push_back(frame);
+    }
+
+    // Standing still over the revolution, the de-skewing still looks up every point
+    PoseHistory poseHistory;
+    for (uint64_t t = 0; t <= 2 * REVOLUTION_TIME_US; t += 2000) poseHistory.push(t, Vec2f(0.0f, 0.0f), 0.0f);
+
+    // The frames jump between random positions, so the filter also resamples and brings in random particles
+    DistanceField distanceField;
+    distanceField.build(environment);
+    slam.particleFilter.initialise(frames[0].position, 0.0f, 0.05f, 0.05f, environment);
+
+    // Frame buffers like the ones of RobotSystem
+    LidarScan lidarScan;
+    LidarScan useableScan;
+    std::vector<Obstacle> obstacles;
+    std::vector<Obstacle> filteredObstacles;
+#ifndef HAVE_OPENCV
+    const std::vector<Obstacle> fixedObstacles = {Obstacle(Vec2f(1.0f, 0.4f), 4, 40), Obstacle(Vec2f(2.6f, 1.5f), 1, 35)};
+#endif
+    RUN_DIRECTION runDirection;
+    long results = 0;
+    size_t fewestUseablePoints = TEST_RAYS;
+    for (int pass = 0; pass < 2; pass++) {
+        countAllocations = pass == 1;
+        for (const Frame& frame : frames) {
+            dpd.clear();
+            const Vec2f& estimatedPosition = frame.position;
+            lidarScan = frame.scan; // Reuses the capacity
+            slam.deskewScan(lidarScan, poseHistory);
+            lidarScan.rotate(0.0f);
+            useableScan.scan.clear(); // getUsablePoints appends
+            slam.getUsablePoints(lidarScan, estimatedPosition, environment, useableScan);
+            fewestUseablePoints = std::min(fewestUseablePoints, useableScan.scan.size());
+            std::optional<float> heading = slam.lidarEstimateHeading(useableScan, environment, estimatedPosition);
+            std::optional<LidarPoseEstimate> pose = slam.lidarEstimatePose(useableScan, environment, estimatedPosition);
+            if (heading.has_value()) lidarScan.rotate(heading.value());
+            useableScan.scan.clear();
+            slam.getUsablePoints(lidarScan, estimatedPosition, environment, useableScan);
+            std::optional<Vec2f> position = slam.lidarEstimatePosition(useableScan, environment, estimatedPosition);
+            slam.getRunDirection(estimatedPosition, 0.0f, frame.scan, RUN_TYPE_OPENING_RUN, runDirection, false);
+            results += heading.has_value() + position.has_value() + pose.has_value();
+
+            useableScan.scan.clear();
+            slam.getDistanceUseablePoints(lidarScan, useableScan);
+            obstacles.clear();
+#ifdef HAVE_OPENCV
+            obstacleDetection.feedScan(useableScan, estimatedPosition);
+            obstacleDetection.getObstacles(obstacles);
+#else
+            obstacles = fixedObstacles; // Reuses the capacity
+#endif
+            pathfinder.filterObstacles(obstacles, filteredObstacles);
+
+            slam.particleFilter.predict(0.02f, 0.01f);
+            std::optional<ParticlePose> particlePose = slam.particleFilter.update(useableScan, distanceField);
+            results += particlePose.has_value();
+        }
+    }
+    countAllocations = false;
+
+    printf("%ld allocations in %d frames after the warm up, %ld estimates, at least %zu usable points per frame\n", allocations, TEST_FRAMES, results, fewestUseablePoints);
+    if (results < 2 * 4 * TEST_FRAMES) {
+        printf("Not every estimate succeeded, the frames did not exercise the estimation\n");
+        return 1;
+    }
+    if (fewestUseablePoints < MIN_USEABLE_POINTS) {
+        printf("A frame had fewer than %d usable points\n", MIN_USEABLE_POINTS);
+        return 1;
+    }
+    return allocations == 0 ? 0 : 1;
+}
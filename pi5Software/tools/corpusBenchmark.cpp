@@ -0,0 +1,96 @@
+// Time per revolution of the lidar passes of updateLidar over the real scans of the imported corpus
+// The poses are tracked through the corpus first, then every pass is timed alone on the inputs it gets on the robot
+// Build with optimisation, the numbers of a debug build say nothing: cmake -DCMAKE_BUILD_TYPE=Release
+// Usage: corpusBenchmark [corpus], the corpus defaults to the one importLidarTestData made in the build directory
+
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "CorpusTracking.h"
+#include "DisplayData.h"
+#ifdef HAVE_OPENCV
+#include "ObstacleDetection.h"
+#endif
+
+#define BENCHMARK_PASSES 5 // Over the whole corpus, the samples of all passes are pooled
+
+DisplayData dpd; // Defined in main.cpp for the robot
+
+// Calls function(i) for every revolution and prints mean, median and worst time per call
+template<typename Function>
+static void timeRevolutions(const char* name, size_t count, Function function) {
+    std::vector<double> samples;
+    samples.reserve(count * BENCHMARK_PASSES);
+    for (int pass = 0; pass < BENCHMARK_PASSES; pass++) {
+        for (size_t i = 0; i < count; i++) {
+            dpd.clear(); // The passes append debug points
+            auto start = std::chrono::steady_clock::now();
+            function(i);
+            auto end = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+    }
+    double sum = 0.0;
+    for (double sample : samples) sum += sample;
+    std::sort(samples.begin(), samples.end());
+    printf("%-24s mean %8.2f us  median %8.2f us  max %8.2f us\n", name, sum / samples.size(), samples[samples.size() / 2], samples.back());
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : DEFAULT_CORPUS_PATH;
+    LidarCorpus corpus;
+    if (!corpus.open(path)) {
+        fprintf(stderr, "Could not open the corpus %s, run importLidarTestData first\n", path);
+        return 1;
+    }
+    Environment environment(0.16f, RUN_TYPE_OBSTACLE_RUN, false);
+    std::vector<CorpusPose> poses;
+    size_t tracked = trackCorpus(corpus, environment, poses);
+    printf("%zu revolutions, %zu tracked\n", corpus.size(), tracked);
+
+    // The inputs of every pass, prepared once so only the pass itself is timed
+    Slam slam;
+    size_t count = corpus.size();
+    std::vector<LidarScan> scans(count);      // Rotated by the tracked heading
+    std::vector<LidarScan> useable(count);    // Input of the heading estimate
+    std::vector<LidarScan> corrected(count);  // Input of the position estimate, after the heading correction
+    std::vector<LidarScan> distanceUseable(count); // Input of the obstacle detection
+    size_t points = 0;
+    size_t useablePoints = 0;
+    for (size_t i = 0; i < count; i++) {
+        prepareCorpusScan(corpus, i, poses[i], slam, environment, scans[i], useable[i]);
+        LidarScan rotated = scans[i];
+        std::optional<float> headingError = slam.lidarEstimateHeading(useable[i], environment, poses[i].position);
+        if (headingError.has_value()) rotated.rotate(headingError.value());
+        slam.getUsablePoints(rotated, poses[i].position, environment, corrected[i]);
+        slam.getDistanceUseablePoints(scans[i], distanceUseable[i]);
+        points += scans[i].scan.size();
+        useablePoints += useable[i].scan.size();
+    }
+    printf("%.0f points and %.0f usable points per revolution\n", double(points) / count, double(useablePoints) / count);
+
+    LidarScan output;
+    size_t estimates = 0; // Keeps the calls from being removed
+    timeRevolutions("getUsablePoints", count, [&](size_t i) {
+        output.scan.clear();
+        slam.getUsablePoints(scans[i], poses[i].position, environment, output);
+    });
+    timeRevolutions("lidarEstimateHeading", count, [&](size_t i) {
+        estimates += slam.lidarEstimateHeading(useable[i], environment, poses[i].position).has_value();
+    });
+    timeRevolutions("lidarEstimatePosition", count, [&](size_t i) {
+        estimates += slam.lidarEstimatePosition(corrected[i], environment, poses[i].position).has_value();
+    });
+#ifdef HAVE_OPENCV
+    ObstacleDetection obstacleDetection;
+    timeRevolutions("feedScan", count, [&](size_t i) {
+        obstacleDetection.feedScan(distanceUseable[i], poses[i].position);
+    });
+#else
+    printf("feedScan skipped, built without OpenCV\n");
+#endif
+    printf("%zu estimates\n", estimates);
+    return 0;
+}
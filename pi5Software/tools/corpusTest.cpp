@@ -0,0 +1,184 @@
+// Checks the estimates of the lidar passes against the versions they replaced, on the real scans of the imported corpus
+// The replaced versions are kept below as the reference, each revolution is fed to both with the tracked pose as prior
+// Registered with ctest, run it after touching lidarEstimateHeading, LineMoments or lidarEstimatePosition
+// Usage: corpusTest [corpus], the corpus defaults to the one importLidarTestData made in the build directory
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <optional>
+#include <algorithm>
+
+#include "CorpusTracking.h"
+#include "DisplayData.h"
+
+#define HEADING_MAX_DIFFERENCE 1e-7 // rad, the moments are summed in double where the regression summed in float
+#define POSITION_MAX_DIFFERENCE 0.00045 // m, float rounding of the pairwise sums of the reference
+
+DisplayData dpd; // Defined in main.cpp for the robot
+
+static int failures = 0;
+
+static void check(const char* name, double difference, double bound, size_t compared) {
+    bool ok = difference <= bound && compared > 0;
+    printf("%-22s %zu revolutions, max difference %.2e, bound %.2e %s\n", name, compared, difference, bound, ok ? "" : "FAILED");
+    if (!ok) failures++;
+}
+
+// linearRegression of Slam before the LineMoments, two passes over the points of one wall
+static Line referenceLinearRegression(const std::vector<Vec2f>& points) {
+    if (points.size() < 2) return Line();
+    Vec2f centroid(0.0f, 0.0f);
+    for (const auto& p : points) {
+        centroid.x += p.x;
+        centroid.y += p.y;
+    }
+    centroid.x /= points.size();
+    centroid.y /= points.size();
+
+    float Sxx = 0.0f, Syy = 0.0f, Sxy = 0.0f;
+    for (const auto& p : points) {
+        float dx = p.x - centroid.x;
+        float dy = p.y - centroid.y;
+        Sxx += dx * dx;
+        Syy += dy * dy;
+        Sxy += dx * dy;
+    }
+    float theta = 0.5f * atan2f(2.0f * Sxy, Sxx - Syy);
+    Vec2f direction(cosf(theta), sinf(theta));
+    return Line(centroid - direction, centroid + direction);
+}
+
+// compareLines of Slam, private there
+static std::optional<float> referenceCompareLines(const Slam& slam, const Landmark& a, const Line& b) {
+    Vec2f dirB = b.direction();
+    float lenB = dirB.length();
+    if (a.length < 1e-6f || lenB < 1e-6f) return std::nullopt;
+    dirB = dirB * (1.0f / lenB);
+    Vec2f dirBR = dirB * -1.0f;
+
+    float angleA = a.angle;
+    if (angleA > M_PI/2.0f) angleA -= M_PI;
+    if (angleA < -M_PI/2.0f) angleA += M_PI;
+    float angleDiffNormal = atan2f(dirB.y, dirB.x) - angleA;
+    float angleDiffReversed = atan2f(dirBR.y, dirBR.x) - angleA;
+    float angleDiff = fabsf(angleDiffNormal) < fabsf(angleDiffReversed) ? angleDiffNormal : angleDiffReversed;
+    if (fabsf(angleDiff) >= slam.maxLineDeviation) return std::nullopt;
+    return angleDiff;
+}
+
+// lidarEstimateHeading before the LineMoments, one pass over the scan per landmark and a regression per wall
+static std::optional<float> referenceEstimateHeading(const Slam& slam, const LidarScan& scan, const Environment& environment) {
+    float angleSum = 0.0f;
+    int count = 0;
+    std::vector<Vec2f> points;
+    for (int i = 0; i < (int)environment.landmarks.size(); i++) {
+        points.clear();
+        for (const LidarPoint& lp : scan.scan) {
+            if (lp.lmIndex == i) points.push_back(lp.point());
+        }
+        if ((int)points.size() < slam.minPointsForLine) continue;
+        std::optional<float> angle = referenceCompareLines(slam, environment.landmarks[i], referenceLinearRegression(points));
+        if (!angle.has_value()) continue;
+        angleSum += angle.value();
+        count++;
+    }
+    if (count == 0) return std::nullopt;
+    return -angleSum / float(count);
+}
+
+// |sin| of the angle between two lines, the weight of their intersection
+static float referenceAngleWeight(const Line& a, const Line& b) {
+    Vec2f A = a.direction();
+    Vec2f B = b.direction();
+    float lenA = A.length();
+    float lenB = B.length();
+    if (lenA == 0.0f || lenB == 0.0f) return 0.0f;
+    return fabsf(A.x * B.y - A.y * B.x) / (lenA * lenB);
+}
+
+// lidarEstimatePosition before the normal equations, one parallel per point and the weighted average of all pairwise intersections
+static std::optional<Vec2f> referenceEstimatePosition(const LidarScan& scan, const Environment& environment, const Vec2f& estimatedPosition) {
+    std::vector<Line> parallels;
+    for (const LidarPoint& lp : scan.scan) {
+        if (lp.lmIndex == -1) continue;
+        const Landmark& landmark = environment.landmarks[lp.lmIndex];
+        float perpendicularDistance = lp.distance * fabsf(lp.getDirection().dot(landmark.normal));
+        Vec2f shift = landmark.normal * perpendicularDistance;
+        if (landmark.signedDistance(estimatedPosition) <= 0.0f) shift = shift * -1.0f;
+        parallels.push_back(Line(landmark.line.start + shift, landmark.line.end + shift));
+    }
+
+    double totalWeight = 0.0;
+    Vec2f weightedSum(0.0f, 0.0f);
+    for (size_t i = 0; i < parallels.size(); i++) {
+        for (size_t j = i + 1; j < parallels.size(); j++) {
+            std::optional<Vec2f> p = Line::intersectionInfinite(parallels[i], parallels[j]);
+            if (!p.has_value()) continue;
+            float w = referenceAngleWeight(parallels[i], parallels[j]);
+            if (w <= 1e-8f) continue;
+            weightedSum.x += p->x * w;
+            weightedSum.y += p->y * w;
+            totalWeight += w;
+        }
+    }
+    if (totalWeight == 0.0) return std::nullopt;
+    float inv = 1.0f / static_cast<float>(totalWeight);
+    return Vec2f(weightedSum.x * inv, weightedSum.y * inv);
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : DEFAULT_CORPUS_PATH;
+    LidarCorpus corpus;
+    if (!corpus.open(path)) {
+        fprintf(stderr, "Could not open the corpus %s, run importLidarTestData first\n", path);
+        return 1;
+    }
+    Environment environment(0.16f, RUN_TYPE_OBSTACLE_RUN, false);
+    std::vector<CorpusPose> poses;
+    size_t tracked = trackCorpus(corpus, environment, poses);
+    printf("%zu revolutions, %zu tracked\n", corpus.size(), tracked);
+
+    Slam slam;
+    LidarScan scan;
+    LidarScan useable;
+    double headingDifference = 0.0;
+    size_t headingCompared = 0;
+    double positionDifference = 0.0;
+    size_t positionCompared = 0;
+    for (size_t i = CORPUS_SETTLE_REVOLUTIONS; i < corpus.size(); i++) {
+        dpd.clear();
+        if (!prepareCorpusScan(corpus, i, poses[i], slam, environment, scan, useable)) continue;
+
+        std::optional<float> heading = slam.lidarEstimateHeading(useable, environment, poses[i].position);
+        std::optional<float> referenceHeading = referenceEstimateHeading(slam, useable, environment);
+        if (heading.has_value() != referenceHeading.has_value()) {
+            printf("Revolution %zu: only one heading version has an estimate\n", i);
+            failures++;
+            continue;
+        }
+        if (!heading.has_value()) continue;
+        headingDifference = std::max(headingDifference, (double)fabsf(heading.value() - referenceHeading.value()));
+        headingCompared++;
+
+        // The position estimate gets the scan after the heading correction, like in updateLidar
+        scan.rotate(heading.value());
+        useable.scan.clear();
+        slam.getUsablePoints(scan, poses[i].position, environment, useable);
+        std::optional<Vec2f> position = slam.lidarEstimatePosition(useable, environment, poses[i].position);
+        std::optional<Vec2f> referencePosition = referenceEstimatePosition(useable, environment, poses[i].position);
+        if (position.has_value() != referencePosition.has_value()) {
+            printf("Revolution %zu: only one position version has an estimate\n", i);
+            failures++;
+            continue;
+        }
+        if (!position.has_value()) continue;
+        positionDifference = std::max(positionDifference, (double)(position.value() - referencePosition.value()).length());
+        positionCompared++;
+    }
+    check("lidarEstimateHeading", headingDifference, HEADING_MAX_DIFFERENCE, headingCompared);
+    check("lidarEstimatePosition", positionDifference, POSITION_MAX_DIFFERENCE, positionCompared);
+
+    if (failures) printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
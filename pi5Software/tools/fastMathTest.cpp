@@ -0,0 +1,108 @@
+// Sweeps FastMath and TrigTable against atan2f, fmodf, sinf and cosf of libm and fails if an error bound is exceeded
+// Registered with ctest, run it after changing a polynomial, the table size or the wrapping
+
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include "FastMath.h"
+#include "TrigTable.h"
+
+#define SWEEP_STEPS 2000000
+#define SWEEP_TURNS 8.0f       // The angles of the robot stay within a few turns, the sweep covers both directions
+#define WRAP_MAX_ERROR 2e-6f   // Float rounding of a few turns, the same fmodf has
+#define SINCOS_MAX_ERROR 1.2e-7f // One ulp of values up to 1
+
+static int failures = 0;
+
+static void check(const char* name, double error, double bound) {
+    bool ok = error <= bound;
+    printf("%-31s max error %.2e, bound %.2e %s\n", name, error, bound, ok ? "" : "FAILED");
+    if (!ok) failures++;
+}
+
+static void expect(const char* name, bool ok) {
+    if (ok) return;
+    printf("%s FAILED\n", name);
+    failures++;
+}
+
+// Distance of two angles on the circle, so 0 and a value just below 2*PI count as equal
+static double circularError(double a, double b) {
+    double d = fabs(a - b);
+    return std::min(d, 2.0 * M_PI - d);
+}
+
+static float fmodWrap(float angle) {return fmodf(fmodf(angle, FastMath::TWO_PI) + FastMath::TWO_PI, FastMath::TWO_PI);}
+
+int main() {
+    // atan2 over the full circle and over radii from close to the origin to the arena size
+    double atanError = 0.0;
+    for (int i = 0; i <= SWEEP_STEPS; i++) {
+        float angle = (2.0f * i / SWEEP_STEPS - 1.0f) * FastMath::PI;
+        float radius = 0.001f + 3.0f * (i % 97) / 97.0f;
+        float x = radius * cosf(angle);
+        float y = radius * sinf(angle);
+        atanError = std::max(atanError, circularError(FastMath::atan2(y, x), atan2f(y, x)));
+    }
+    check("atan2", atanError, FastMath::ATAN2_MAX_ERROR);
+    expect("atan2(0, 0) == 0", FastMath::atan2(0.0f, 0.0f) == 0.0f);
+    expect("atan2 on the axes", FastMath::atan2(0.0f, 1.0f) == 0.0f && fabsf(FastMath::atan2(1.0f, 0.0f) - 0.5f * FastMath::PI) <= FastMath::ATAN2_MAX_ERROR
+        && fabsf(FastMath::atan2(0.0f, -1.0f) - FastMath::PI) <= FastMath::ATAN2_MAX_ERROR && fabsf(FastMath::atan2(-1.0f, 0.0f) + 0.5f * FastMath::PI) <= FastMath::ATAN2_MAX_ERROR);
+
+    // wrapAngle and angleDifference against fmodf, and their ranges
+    double wrapError = 0.0;
+    double differenceError = 0.0;
+    bool wrapInRange = true;
+    bool differenceInRange = true;
+    for (int i = 0; i <= SWEEP_STEPS; i++) {
+        float angle = (2.0f * i / SWEEP_STEPS - 1.0f) * SWEEP_TURNS * FastMath::TWO_PI;
+        float wrapped = FastMath::wrapAngle(angle);
+        wrapInRange = wrapInRange && wrapped >= 0.0f && wrapped < FastMath::TWO_PI;
+        wrapError = std::max(wrapError, circularError(wrapped, fmodWrap(angle)));
+
+        float reference = 1.3f * i / SWEEP_STEPS; // A second angle that moves against the first
+        float difference = FastMath::angleDifference(angle, reference);
+        differenceInRange = differenceInRange && difference >= -FastMath::PI && difference < FastMath::PI;
+        float expected = fmodWrap(angle - reference);
+        if (expected >= FastMath::PI) expected -= FastMath::TWO_PI;
+        differenceError = std::max(differenceError, circularError(difference, expected));
+    }
+    check("wrapAngle", wrapError, WRAP_MAX_ERROR);
+    check("angleDifference", differenceError, WRAP_MAX_ERROR);
+    expect("wrapAngle in [0, 2*PI)", wrapInRange);
+    expect("angleDifference in [-PI, PI)", differenceInRange);
+    expect("wrapAngle of a tiny negative angle", FastMath::wrapAngle(-1e-9f) < FastMath::TWO_PI);
+
+    // sinCos against sinf and cosf, it is libm as well so only rounding may differ
+    double sinCosError = 0.0;
+    for (int i = 0; i <= SWEEP_STEPS; i++) {
+        float angle = (2.0f * i / SWEEP_STEPS - 1.0f) * SWEEP_TURNS * FastMath::TWO_PI;
+        float s, c;
+        FastMath::sinCos(angle, s, c);
+        sinCosError = std::max({sinCosError, (double)fabsf(s - sinf(angle)), (double)fabsf(c - cosf(angle))});
+    }
+    check("sinCos", sinCosError, SINCOS_MAX_ERROR);
+
+    // binarySweep against the fmodf of degrees it replaced in the lidar backend
+    double sweepError = 0.0;
+    for (uint32_t from = 0; from < 65536; from += 97) {
+        for (uint32_t to = 0; to < 65536; to += 89) {
+            float expected = fmodf(to * 90.0f / 16384.0f - from * 90.0f / 16384.0f + 360.0f, 360.0f) / 360.0f;
+            sweepError = std::max(sweepError, (double)fabsf(FastMath::binarySweep(uint16_t(from), uint16_t(to)) - expected));
+        }
+    }
+    check("binarySweep", sweepError, WRAP_MAX_ERROR);
+
+    // TrigTable against sinf and cosf for every binary angle
+    double binaryError = 0.0;
+    for (uint32_t angle = 0; angle < 65536; angle++) {
+        Vec2f d = TrigTable::directionFromBinary(uint16_t(angle));
+        float radians = float(angle * (2.0 * M_PI / 65536.0));
+        binaryError = std::max({binaryError, (double)fabsf(d.x - cosf(radians)), (double)fabsf(d.y - sinf(radians))});
+    }
+    check("TrigTable::directionFromBinary", binaryError, TrigTable::MAX_ERROR);
+
+    if (failures) printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+// Converts Testing/Data/LidarTestData.txt into a sensor log holding one lidar record per revolution
+// The text file has one "distance angle" pair per line (metres, radians) and "----" between revolutions
+// The result can be memory mapped with LidarCorpus or replayed with the LIDAR_REPLAY backend
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+
+#include "SensorLog.h"
+#include "LidarPoint.h"
+
+#define DEFAULT_INPUT_PATH "../../../Testing/Data/LidarTestData.txt" // Relative to tools/build
+#define DEFAULT_OUTPUT_PATH "LidarTestData.bin"
+#define REVOLUTION_TIME_US 100000 // The text file has no time stamps, 10 Hz is assumed
+#define REVOLUTION_SEPARATOR "----"
+
+// Stamps the revolution and spreads the point capture times over it like the lidar backend does
+static void writeRevolution(SensorLogWriter& writer, LidarScan& revolution, size_t index) {
+    if (revolution.scan.empty()) return;
+    size_t count = revolution.scan.size();
+    for (size_t i = 0; i < count; i++) {
+        revolution.scan[i].time = -float(count - 1 - i) / count * (REVOLUTION_TIME_US / 1000000.0f);
+    }
+    revolution.timestampUs = (index + 1) * REVOLUTION_TIME_US;
+    writer.appendScan(revolution, 1.0f, 0.0f); // The samples are already scaled
+    revolution.scan.clear();
+}
+
+int main(int argc, char** argv) {
+    std::string inputPath = argc > 1 ? argv[1] : DEFAULT_INPUT_PATH;
+    std::string outputPath = argc > 2 ? argv[2] : DEFAULT_OUTPUT_PATH;
+
+    std::ifstream input(inputPath);
+    if (!input) {
+        std::cerr << "Could not open " << inputPath << std::endl;
+        return 1;
+    }
+    remove(outputPath.c_str()); // The writer appends
+    SensorLogWriter writer;
+    if (!writer.open(outputPath)) return 1;
+
+    LidarScan revolution;
+    size_t revolutions = 0;
+    size_t points = 0;
+    size_t skippedLines = 0;
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.rfind(REVOLUTION_SEPARATOR, 0) == 0) {
+            if (!revolution.scan.empty()) writeRevolution(writer, revolution, revolutions++);
+            continue;
+        }
+        std::istringstream fields(line);
+        float distance, angle;
+        if (!(fields >> distance >> angle)) {
+            if (!line.empty()) skippedLines++;
+            continue;
+        }
+        LidarPoint lp;
+        lp.setAngle(angle);
+        lp.distance = distance;
+        revolution.scan.push_back(lp);
+        points++;
+    }
+    if (!revolution.scan.empty()) writeRevolution(writer, revolution, revolutions++);
+    writer.close();
+
+    std::cout << "Wrote " << revolutions << " revolutions with " << points << " points to " << outputPath;
+    if (skippedLines > 0) std::cout << ", skipped " << skippedLines << " malformed lines";
+    std::cout << std::endl;
+    return 0;
+}
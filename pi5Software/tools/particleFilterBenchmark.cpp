@@ -0,0 +1,69 @@
+// Time per scan of ParticleFilter::update for every thread count, on synthetic scans of a drive along the bottom corridor
+// The filter gets the points of getDistanceUseablePoints like localiseWithParticleFilter, the odometry is exact
+// Build with optimisation, the numbers of a debug build say nothing: cmake -DCMAKE_BUILD_TYPE=Release
+// Usage: particleFilterBenchmark [particles]
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "Slam.h"
+#include "Environment.h"
+#include "DistanceField.h"
+#include "ParticleFilter.h"
+#include "DisplayData.h"
+
+#define BENCHMARK_SCANS 100
+#define BENCHMARK_RAYS 720       // Close to the points of a revolution of the real lidar
+#define BENCHMARK_STEP 0.02f     // m driven between two scans
+#define BENCHMARK_MAX_THREADS 4  // The cores of the Pi 5
+
+DisplayData dpd; // Defined in main.cpp for the robot
+
+int main(int argc, char** argv) {
+    int particles = argc > 1 ? atoi(argv[1]) : 1000;
+    Environment environment(0.16f, RUN_TYPE_OBSTACLE_RUN, false);
+    DistanceField distanceField;
+    distanceField.build(environment);
+    std::vector<Line> landmarks;
+    for (const Landmark& landmark : environment.landmarks) landmarks.push_back(landmark.line);
+
+    // Heading 0 all the way, so the scans in world orientation are also the scans in the robot frame
+    Slam slam;
+    std::vector<LidarScan> scans(BENCHMARK_SCANS);
+    std::vector<Vec2f> positions(BENCHMARK_SCANS);
+    LidarScan generated;
+    for (int i = 0; i < BENCHMARK_SCANS; i++) {
+        positions[i] = Vec2f(0.5f + i * BENCHMARK_STEP, 0.5f);
+        generated.scan.clear();
+        slam.generateTestPoints(generated.scan, positions[i], landmarks, 0.5f, 0.01f, BENCHMARK_RAYS);
+        slam.getDistanceUseablePoints(generated, scans[i]);
+    }
+    printf("%d particles, %d scans of about %zu points, %u hardware threads\n", particles, BENCHMARK_SCANS, scans[0].scan.size(), std::thread::hardware_concurrency());
+
+    for (int threads = 1; threads <= BENCHMARK_MAX_THREADS; threads++) {
+        ParticleFilter filter;
+        filter.particleCount = particles;
+        filter.threadCount = threads;
+        filter.initialise(positions[0], 0.0f, 0.05f, 0.05f, environment);
+        std::vector<double> samples;
+        float worstError = 0.0f;
+        for (int i = 0; i < BENCHMARK_SCANS; i++) {
+            if (i > 0) filter.predict(BENCHMARK_STEP, 0.0f);
+            auto start = std::chrono::steady_clock::now();
+            std::optional<ParticlePose> pose = filter.update(scans[i], distanceField);
+            auto end = std::chrono::steady_clock::now();
+            samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+            if (pose.has_value() && i >= 10) worstError = std::max(worstError, (pose->position - positions[i]).length()); // After settling
+        }
+        double sum = 0.0;
+        for (double sample : samples) sum += sample;
+        std::sort(samples.begin(), samples.end());
+        printf("%d threads  mean %8.1f us  median %8.1f us  max %8.1f us  worst position error %.1f mm\n",
+            threads, sum / samples.size(), samples[samples.size() / 2], samples.back(), worstError * 1000.0f);
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Runs a sensor log through the pose estimation offline, without the hardware, the Lidar thread and its mailbox
+// Every record is applied in the order it was logged: gyro and encoder deltas like updateGyro and updateEncoder,
+// lidar scans like the default path of updateLidar (de-skewing, heading and position estimate, blending)
+// The obstacle detection and the camera frames need OpenCV and are left out, camera records are only counted
+// Prints one line per scan: time stamp, pose, usable points and whether heading and position were estimated
+// Usage: replaySensorLog <log> [x y heading [scale subtractor]]
+// The start pose defaults to the usual start of the obstacle run, scale and subtractor to the ones of the Lidar of RobotSystem
+// The imported corpus is already scaled: replaySensorLog LidarTestData.bin 1.5 0.5 0 1 0
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+
+#include "SensorLog.h"
+#include "Slam.h"
+#include "Environment.h"
+#include "PoseHistory.h"
+#include "LidarSectorWindow.h"
+#include "DisplayData.h"
+#include "FastMath.h"
+
+#define DEFAULT_LIDAR_SCALE 1.0f
+#define DEFAULT_LIDAR_SUBTRACTOR 0.3f
+#define LIDAR_SECTOR_COUNT 4  // Of LIDAR_SECTOR_STREAMING, streamed sectors are combined into a full view like in updateLidar
+
+DisplayData dpd; // Defined in main.cpp for the robot
+
+// The pose part of RobotSystem
+struct ReplayPose {
+    float heading = 0.0f;
+    Vec2f position{0.0f, 0.0f};
+    float odometryHeading = 0.0f;
+    Vec2f odometryPosition{0.0f, 0.0f};
+    PoseHistory poseHistory;
+};
+
+static Vec2f boundPosition(Vec2f position, const Environment& environment) {
+    position.x = std::max(environment.outerBottomLeft.x, std::min(position.x, environment.outerTopRight.x));
+    position.y = std::max(environment.outerBottomLeft.y, std::min(position.y, environment.outerTopRight.y));
+    return position;
+}
+
+static void applyGyro(ReplayPose& pose, uint64_t timestampUs, const SensorLogGyro& gyro) {
+    pose.heading = FastMath::wrapAngle(pose.heading + gyro.deltaHeading);
+    pose.odometryHeading = FastMath::wrapAngle(pose.odometryHeading + gyro.deltaHeading);
+    pose.poseHistory.push(timestampUs, pose.odometryPosition, pose.odometryHeading);
+}
+
+static void applyEncoder(ReplayPose& pose, uint64_t timestampUs, const SensorLogEncoder& encoder, const Environment& environment) {
+    pose.position += Vec2f(cosf(pose.heading), sinf(pose.heading)) * encoder.deltaDistance;
+    pose.position = boundPosition(pose.position, environment);
+    pose.odometryPosition += Vec2f(cosf(pose.odometryHeading), sinf(pose.odometryHeading)) * encoder.deltaDistance;
+    pose.poseHistory.push(timestampUs, pose.odometryPosition, pose.odometryHeading);
+}
+
+// The frame buffers of updateLidar
+struct ReplayFrames {
+    LidarScan record;
+    LidarScan scan;
+    LidarScan useable;
+    LidarSectorWindow sectorWindow{LIDAR_SECTOR_COUNT};
+};
+
+static void applyScan(ReplayPose& pose, ReplayFrames& frames, float lidarDt, Slam& slam, const Environment& environment) {
+    LidarScan& scan = frames.scan;
+    slam.deskewScan(scan, pose.poseHistory);
+    scan.rotate(pose.heading);
+
+    LidarScan& useable = frames.useable;
+    useable.scan.clear();
+    slam.getUsablePoints(scan, pose.position, environment, useable);
+    std::optional<float> headingError = slam.lidarEstimateHeading(useable, environment, pose.position);
+    if (headingError.has_value()) {
+        float alpha = std::exp(-lidarDt / LIDAR_HEADING_TAU);
+        pose.heading = FastMath::wrapAngle(pose.heading + headingError.value() * (1.0f - alpha));
+        scan.rotate(headingError.value());
+        useable.scan.clear();
+        slam.getUsablePoints(scan, pose.position, environment, useable);
+    }
+    std::optional<Vec2f> position = slam.lidarEstimatePosition(useable, environment, pose.position);
+    if (position.has_value()) {
+        float alpha = std::exp(-lidarDt / LIDAR_POSITION_TAU);
+        pose.position = boundPosition(pose.position + (position.value() - pose.position) * (1.0f - alpha), environment);
+    }
+    printf("%llu %.4f %.4f %.4f %zu %d %d\n", (unsigned long long)scan.timestampUs, pose.position.x, pose.position.y, pose.heading,
+        useable.scan.size(), headingError.has_value(), position.has_value());
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2 && argc != 5 && argc != 7) {
+        fprintf(stderr, "Usage: %s <log> [x y heading [scale subtractor]]\n", argv[0]);
+        return 1;
+    }
+    SensorLogReader reader;
+    if (!reader.open(argv[1])) return 1;
+
+    Environment environment(0.16f, RUN_TYPE_OBSTACLE_RUN, false);
+    Slam slam;
+    ReplayPose pose;
+    pose.position = argc >= 5 ? Vec2f(strtof(argv[2], nullptr), strtof(argv[3], nullptr)) : Vec2f(1.5f, 0.5f);
+    pose.heading = argc >= 5 ? strtof(argv[4], nullptr) : 0.0f;
+    float scale = argc == 7 ? strtof(argv[5], nullptr) : DEFAULT_LIDAR_SCALE;
+    float subtractor = argc == 7 ? strtof(argv[6], nullptr) : DEFAULT_LIDAR_SUBTRACTOR;
+    ReplayFrames frames;
+    LidarNodeFilter filter; // The defaults of the Lidar
+
+    size_t counts[SENSOR_LOG_LIDAR_NODES + 1] = {};
+    size_t skipped = 0;
+    uint64_t lastScanUs = 0;
+    const SensorLogRecord* record;
+    while ((record = reader.next())) {
+        if (record->type <= SENSOR_LOG_LIDAR_NODES) counts[record->type]++;
+        const void* payload = SensorLogReader::payload(record);
+        if (record->type == SENSOR_LOG_GYRO && record->size >= sizeof(SensorLogGyro)) {
+            applyGyro(pose, record->timestampUs, *static_cast<const SensorLogGyro*>(payload));
+        }
+        else if (record->type == SENSOR_LOG_ENCODER && record->size >= sizeof(SensorLogEncoder)) {
+            applyEncoder(pose, record->timestampUs, *static_cast<const SensorLogEncoder*>(payload), environment);
+        }
+        else if (isSensorLogScan(record->type)) {
+            if (!SensorLogReader::readScan(record, frames.record, scale, subtractor, filter)) {
+                skipped++;
+                continue;
+            }
+            if (frames.record.sector >= 0) {
+                frames.record.sector %= LIDAR_SECTOR_COUNT;
+                frames.sectorWindow.add(frames.record);
+                frames.sectorWindow.assemble(frames.scan);
+            }
+            else {
+                frames.scan.scan.swap(frames.record.scan);
+                frames.scan.timestampUs = frames.record.timestampUs;
+                frames.scan.sector = -1;
+            }
+            float lidarDt = lastScanUs != 0 && record->timestampUs > lastScanUs ? (record->timestampUs - lastScanUs) / 1000000.0f : 0.1f;
+            lastScanUs = record->timestampUs;
+            applyScan(pose, frames, lidarDt, slam, environment);
+        }
+        else if (record->type != SENSOR_LOG_CAMERA) skipped++;
+    }
+
+    fprintf(stderr, "%zu scans, %zu node scans, %zu gyro, %zu encoder, %zu camera records, %zu skipped\n",
+        counts[SENSOR_LOG_LIDAR_SCAN], counts[SENSOR_LOG_LIDAR_NODES], counts[SENSOR_LOG_GYRO], counts[SENSOR_LOG_ENCODER], counts[SENSOR_LOG_CAMERA], skipped);
+    return 0;
+}
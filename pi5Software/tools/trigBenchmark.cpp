@@ -0,0 +1,50 @@
+// Compares TrigTable::directionFromBinary against sinf and cosf of libm on the binary angles of the device
+// Worst error over all 65536 angles and time per sine and cosine pair including the conversion the libm path needs
+// Build with optimisation, the numbers of a debug build say nothing: cmake -DCMAKE_BUILD_TYPE=Release
+
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+#include "TrigTable.h"
+
+#define TIMING_SAMPLES 20000000
+
+// Binary angles that step through the turn without a pattern the table could profit from
+static uint16_t angleAt(int i) {return uint16_t(i * 40503u);}
+
+template<typename Function>
+static double nanosecondsPerCall(Function function, float& sink) {
+    auto start = std::chrono::steady_clock::now();
+    float sum = 0.0f;
+    for (int i = 0; i < TIMING_SAMPLES; i++) {
+        Vec2f d = function(angleAt(i));
+        sum += d.x + d.y;
+    }
+    auto end = std::chrono::steady_clock::now();
+    sink += sum; // Keeps the loop from being removed
+    return std::chrono::duration<double, std::nano>(end - start).count() / TIMING_SAMPLES;
+}
+
+int main() {
+    double maxError = 0.0;
+    for (uint32_t angle = 0; angle < 65536; angle++) {
+        Vec2f d = TrigTable::directionFromBinary(uint16_t(angle));
+        double radians = angle * (2.0 * M_PI / 65536.0);
+        maxError = std::max({maxError, fabs(d.x - cos(radians)), fabs(d.y - sin(radians))});
+    }
+
+    float sink = 0.0f;
+    double libm = nanosecondsPerCall([](uint16_t a) {
+        float radians = a * float(2*M_PI / 65536.0);
+        return Vec2f(cosf(radians), sinf(radians));
+    }, sink);
+    double binary = nanosecondsPerCall([](uint16_t a) {return TrigTable::directionFromBinary(a);}, sink);
+
+    printf("Max error: directionFromBinary %.2e, bound %.2e\n", maxError, TrigTable::MAX_ERROR);
+    printf("sinf + cosf:         %6.2f ns\n", libm);
+    printf("directionFromBinary: %6.2f ns (%.1fx)\n", binary, libm / binary);
+    printf("(checksum %g)\n", sink);
+    return maxError <= TrigTable::MAX_ERROR ? 0 : 1;
+}
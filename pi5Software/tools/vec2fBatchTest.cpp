@@ -0,0 +1,155 @@
+// Checks the Vec2fBatch kernels and SegmentBatch against the scalar Vec2f and Line code, including the tails of counts that are no multiple of 4
+// Built twice and registered with ctest: with the SIMD of the machine and with VEC2F_BATCH_SCALAR for the scalar loops
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "Vec2fBatch.h"
+#include "Environment.h"
+
+#define MAX_COUNT 13      // Covers empty arrays, whole groups of four and every tail
+#define RANDOM_RAYS 20000
+#define MAX_ERROR 1e-5f   // Float rounding of values of a few metres
+
+static int failures = 0;
+
+static void check(const char* name, double error) {
+    bool ok = error <= MAX_ERROR;
+    printf("%-42s max error %.2e %s\n", name, error, ok ? "" : "FAILED");
+    if (!ok) failures++;
+}
+
+static void expect(const char* name, bool ok) {
+    if (ok) return;
+    printf("%s FAILED\n", name);
+    failures++;
+}
+
+// The closest hit by Line::intersectionSegment, the reference of both kernels; Returns -1 if the ray hits nothing
+static int referenceHit(const Line& ray, const Line* segments, size_t count, float& t) {
+    int best = -1;
+    t = std::numeric_limits<float>::infinity();
+    float length = (ray.end - ray.start).length();
+    for (size_t i = 0; i < count; i++) {
+        std::optional<Vec2f> hit = Line::intersectionSegment(ray, segments[i]);
+        if (!hit.has_value()) continue;
+        float segmentT = (hit.value() - ray.start).length() / length;
+        if (segmentT < t) {
+            t = segmentT;
+            best = int(i);
+        }
+    }
+    return best;
+}
+
+// Error of a kernel hit against the reference; Two segments can be hit at the same t (a corner), then either index is right
+static double hitError(int index, float t, int referenceIndex, float referenceT, const char* name) {
+    if (index == -1 || referenceIndex == -1) {
+        if (index != referenceIndex) {
+            printf("%s: hit %d, reference %d\n", name, index, referenceIndex);
+            return 1.0;
+        }
+        return 0.0;
+    }
+    return fabsf(t - referenceT);
+}
+
+static Vec2f randomPoint(std::mt19937& rng) {
+    std::uniform_real_distribution<float> coordinate(-0.5f, 3.5f);
+    return Vec2f(coordinate(rng), coordinate(rng));
+}
+
+int main() {
+#if defined(VEC2F_BATCH_SIMD)
+    printf("SIMD kernels\n");
+#else
+    printf("Scalar kernels\n");
+#endif
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> angle(-M_PI, M_PI);
+
+    // transform and distanceSquared for every count up to MAX_COUNT
+    double transformError = 0.0;
+    double inPlaceError = 0.0;
+    double distanceError = 0.0;
+    for (size_t count = 0; count <= MAX_COUNT; count++) {
+        std::vector<Vec2f> points(count);
+        for (Vec2f& p : points) p = randomPoint(rng);
+        float a = angle(rng);
+        Vec2f rotation(cosf(a), sinf(a));
+        Vec2f translation = randomPoint(rng);
+        Vec2f centre = randomPoint(rng);
+
+        std::vector<Vec2f> out(count);
+        Vec2fBatch::transform(points.data(), out.data(), count, rotation, translation);
+        std::vector<Vec2f> inPlace = points;
+        Vec2fBatch::transform(inPlace.data(), inPlace.data(), count, rotation, translation);
+        std::vector<float> distances(count);
+        Vec2fBatch::distanceSquared(points.data(), count, centre, distances.data());
+        for (size_t i = 0; i < count; i++) {
+            Vec2f p = points[i];
+            Vec2f expected(p.x * rotation.x - p.y * rotation.y + translation.x, p.x * rotation.y + p.y * rotation.x + translation.y);
+            transformError = std::max(transformError, (double)(out[i] - expected).length());
+            inPlaceError = std::max(inPlaceError, (double)(inPlace[i] - expected).length());
+            distanceError = std::max(distanceError, (double)fabsf(distances[i] - (p - centre).lengthSquared()));
+        }
+    }
+    check("transform", transformError);
+    check("transform in place", inPlaceError);
+    check("distanceSquared", distanceError);
+
+    // closestIntersection and SegmentBatch against Line::intersectionSegment, random walls of every count and the arena
+    double closestError = 0.0;
+    double segmentError = 0.0;
+    int hits = 0;
+    for (int r = 0; r < RANDOM_RAYS; r++) {
+        size_t count = r % (MAX_COUNT + 1);
+        std::vector<Line> segments(count);
+        for (Line& segment : segments) segment = Line(randomPoint(rng), randomPoint(rng));
+        SegmentBatch batch(segments);
+        Vec2f origin = randomPoint(rng);
+        float a = angle(rng);
+        Line ray(origin, origin + Vec2f(cosf(a), sinf(a)) * 4.0f);
+
+        float referenceT, t;
+        int reference = referenceHit(ray, segments.data(), count, referenceT);
+        hits += reference != -1;
+        int index = Vec2fBatch::closestIntersection(ray, segments.data(), count, t);
+        closestError = std::max(closestError, hitError(index, t, reference, referenceT, "closestIntersection"));
+        index = batch.closestHit(ray, t);
+        segmentError = std::max(segmentError, hitError(index, t, reference, referenceT, "SegmentBatch::closestHit"));
+    }
+    check("closestIntersection on random walls", closestError);
+    check("SegmentBatch::closestHit on random walls", segmentError);
+    expect("random rays hit something", hits > RANDOM_RAYS / 4);
+
+    Environment environment(0.16f, RUN_TYPE_OBSTACLE_RUN, false);
+    std::vector<Line> landmarks;
+    for (const Landmark& landmark : environment.landmarks) landmarks.push_back(landmark.line);
+    std::vector<Line> rays;
+    for (int r = 0; r < RANDOM_RAYS; r++) {
+        Vec2f origin(0.2f + 2.6f * (r % 101) / 101.0f, 0.2f + 2.6f * (r % 89) / 89.0f);
+        float a = angle(rng);
+        rays.push_back(Line(origin, origin + Vec2f(cosf(a), sinf(a)) * 4.0f));
+    }
+    std::vector<int> indices(rays.size());
+    std::vector<float> hitT(rays.size());
+    environment.landmarkSegments.closestHits(rays.data(), rays.size(), indices.data(), hitT.data());
+    double arenaError = 0.0;
+    double arenaBatchError = 0.0;
+    for (size_t r = 0; r < rays.size(); r++) {
+        float referenceT, t;
+        int reference = referenceHit(rays[r], landmarks.data(), landmarks.size(), referenceT);
+        int index = Vec2fBatch::closestIntersection(rays[r], landmarks.data(), landmarks.size(), t);
+        arenaError = std::max(arenaError, hitError(index, t, reference, referenceT, "closestIntersection"));
+        arenaBatchError = std::max(arenaBatchError, hitError(indices[r], hitT[r], reference, referenceT, "SegmentBatch::closestHits"));
+    }
+    check("closestIntersection on the arena", arenaError);
+    check("SegmentBatch::closestHits on the arena", arenaBatchError);
+
+    if (failures) printf("%d checks failed\n", failures);
+    return failures ? 1 : 0;
+}